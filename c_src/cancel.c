@@ -0,0 +1,146 @@
+#include <glib-object.h>
+#include <vips/vips.h>
+
+#include "cancel.h"
+#include "utils.h"
+
+/* A cancel token is passed along with a call which evaluates an image.
+ * libvips does not offer a way to interrupt a computation from outside,
+ * but it checks the kill flag of every image in the pipeline while
+ * generating pixels. So we watch the "eval" progress signal and set the
+ * kill flag once the token is cancelled.
+ *
+ * Images are shared between processes, so instead of marking the input
+ * image itself, the evaluation is done on a lightweight copy of it.
+ * Killing the copy only fails the computation of the current call.
+ */
+
+static ErlNifResourceType *CANCEL_TOKEN_RT;
+
+static void cancel_token_rt_dtor(ErlNifEnv *env, void *obj) {
+  debug("VixCancelToken cancel_token_rt_dtor called");
+}
+
+static void cancel_token_rt_down(ErlNifEnv *env, void *obj, ErlNifPid *pid,
+                                 ErlNifMonitor *monitor) {
+  VixCancelToken *token = (VixCancelToken *)obj;
+  debug("cancel token owner is down");
+  g_atomic_int_set(&token->cancelled, 1);
+}
+
+ERL_NIF_TERM nif_cancel_token_new(ErlNifEnv *env, int argc,
+                                  const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  VixCancelToken *token;
+  ErlNifPid pid;
+  ErlNifSInt64 timeout;
+  ERL_NIF_TERM ret;
+  int monitor_ret;
+
+  token = enif_alloc_resource(CANCEL_TOKEN_RT, sizeof(VixCancelToken));
+  token->cancelled = 0;
+  token->deadline = 0;
+
+  if (enif_get_int64(env, argv[1], &timeout)) {
+    if (timeout < 0) {
+      ret = make_error(env, "timeout must be a non-negative integer");
+      goto exit;
+    }
+
+    token->deadline = enif_monotonic_time(ERL_NIF_USEC) + timeout * 1000;
+  } else if (enif_compare(argv[1], ATOM_NIL) != 0) {
+    ret = make_error(env, "timeout must be an integer or nil");
+    goto exit;
+  }
+
+  if (enif_get_local_pid(env, argv[0], &pid)) {
+    monitor_ret = enif_monitor_process(env, token, &pid, NULL);
+
+    if (monitor_ret < 0) {
+      ret = make_error(env, "no down callback is provided");
+      goto exit;
+    } else if (monitor_ret > 0) {
+      // owner is already dead, nothing to compute for
+      token->cancelled = 1;
+    }
+  } else if (enif_compare(argv[0], ATOM_NIL) != 0) {
+    ret = make_error(env, "owner must be a local pid or nil");
+    goto exit;
+  }
+
+  ret = make_ok(env, enif_make_resource(env, token));
+
+exit:
+  enif_release_resource(token);
+  return ret;
+}
+
+bool get_cancel_token(ErlNifEnv *env, ERL_NIF_TERM term,
+                      VixCancelToken **token) {
+  return enif_get_resource(env, term, CANCEL_TOKEN_RT, (void **)token);
+}
+
+bool cancel_token_is_cancelled(VixCancelToken *token) {
+  if (g_atomic_int_get(&token->cancelled))
+    return true;
+
+  if (token->deadline > 0 &&
+      enif_monotonic_time(ERL_NIF_USEC) >= token->deadline) {
+    g_atomic_int_set(&token->cancelled, 1);
+    return true;
+  }
+
+  return false;
+}
+
+static void cancel_on_eval(VipsImage *image, VipsProgress *progress,
+                           VixCancelToken *token) {
+  if (cancel_token_is_cancelled(token)) {
+    debug("cancelling image evaluation");
+    vips_image_set_kill(image, TRUE);
+  }
+}
+
+/* Returns a new reference to a copy of `image` which is killed once
+ * the token is cancelled. The copy must be released with
+ * `cancel_unwatch_image` before the token goes away */
+VipsImage *cancel_watch_image(VixCancelToken *token, VipsImage *image,
+                              VixCancelWatch *watch) {
+  VipsImage *copy;
+
+  if (vips_copy(image, &copy, NULL))
+    return NULL;
+
+  // images derived from the copy emit progress signals on the copy
+  vips_image_set_progress(copy, TRUE);
+  watch->handler_id =
+      g_signal_connect(copy, "eval", G_CALLBACK(cancel_on_eval), token);
+  watch->image = copy;
+
+  return copy;
+}
+
+void cancel_unwatch_image(VixCancelWatch *watch) {
+  if (!watch->image)
+    return;
+
+  g_signal_handler_disconnect(watch->image, watch->handler_id);
+  vips_image_set_progress(watch->image, FALSE);
+  g_object_unref(watch->image);
+  watch->image = NULL;
+}
+
+int nif_cancel_init(ErlNifEnv *env) {
+  ErlNifResourceTypeInit cancel_token_rt_init;
+
+  cancel_token_rt_init.dtor = cancel_token_rt_dtor;
+  cancel_token_rt_init.stop = NULL;
+  cancel_token_rt_init.down = cancel_token_rt_down;
+
+  CANCEL_TOKEN_RT = enif_open_resource_type_x(
+      env, "cancel token resource", &cancel_token_rt_init,
+      ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+
+  return 0;
+}
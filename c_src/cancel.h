@@ -0,0 +1,36 @@
+#ifndef VIX_CANCEL_H
+#define VIX_CANCEL_H
+
+#include "erl_nif.h"
+#include <glib-object.h>
+#include <stdbool.h>
+#include <vips/vips.h>
+
+typedef struct _VixCancelToken {
+  /* set from the owner DOWN callback or once the deadline passes */
+  gint cancelled;
+  /* monotonic deadline in microseconds, 0 if there is no deadline */
+  ErlNifTime deadline;
+} VixCancelToken;
+
+typedef struct _VixCancelWatch {
+  VipsImage *image;
+  gulong handler_id;
+} VixCancelWatch;
+
+ERL_NIF_TERM nif_cancel_token_new(ErlNifEnv *env, int argc,
+                                  const ERL_NIF_TERM argv[]);
+
+bool get_cancel_token(ErlNifEnv *env, ERL_NIF_TERM term,
+                      VixCancelToken **token);
+
+bool cancel_token_is_cancelled(VixCancelToken *token);
+
+VipsImage *cancel_watch_image(VixCancelToken *token, VipsImage *image,
+                              VixCancelWatch *watch);
+
+void cancel_unwatch_image(VixCancelWatch *watch);
+
+int nif_cancel_init(ErlNifEnv *env);
+
+#endif
@@ -0,0 +1,130 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glib-object.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <vips/vips.h>
+
+#include "fd_target.h"
+#include "g_object/g_object.h"
+#include "utils.h"
+
+/* A target writing to a file descriptor owned by the caller, such as a
+ * socket. `vips_target_new_to_descriptor` fails on the first EAGAIN,
+ * and sockets used by the runtime are always nonblocking, so writes are
+ * done by a custom target which waits for the descriptor to become
+ * writable instead.
+ *
+ * The descriptor is duplicated, the caller keeps ownership of the
+ * original one. The duplicate is closed as soon as the saver ends the
+ * target, so the peer sees EOF once the caller closes the original.
+ * Releasing the target closes it as well, in case the saver fails
+ * before ending the target.
+ */
+
+typedef struct _VixFdTarget {
+  int fd;
+  /* poll timeout in milliseconds, -1 to wait forever */
+  int timeout;
+} VixFdTarget;
+
+static gint64 fd_target_on_write(VipsTargetCustom *target, const void *data,
+                                 gint64 length, VixFdTarget *fd_target) {
+  struct pollfd pfd;
+  ssize_t size;
+  int ret;
+
+  while (true) {
+    size = write(fd_target->fd, data, (size_t)length);
+
+    if (size >= 0)
+      return size;
+
+    if (errno == EINTR)
+      continue;
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      vips_error("VixFdTarget", "write failed: %s", strerror(errno));
+      return -1;
+    }
+
+    pfd.fd = fd_target->fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    do {
+      ret = poll(&pfd, 1, fd_target->timeout);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == 0) {
+      vips_error("VixFdTarget", "%s", "write timed out");
+      return -1;
+    } else if (ret < 0) {
+      vips_error("VixFdTarget", "poll failed: %s", strerror(errno));
+      return -1;
+    }
+  }
+}
+
+#if (VIPS_MAJOR_VERSION < 8) ||                                                \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION < 13)
+static void fd_target_on_finish(VipsTargetCustom *target,
+                                VixFdTarget *fd_target) {
+  close_fd(&fd_target->fd);
+}
+#else
+static int fd_target_on_end(VipsTargetCustom *target, VixFdTarget *fd_target) {
+  return close_fd(&fd_target->fd) == 0 ? 0 : -1;
+}
+#endif
+
+static void fd_target_on_target_dispose(gpointer data,
+                                        GObject *where_the_object_was) {
+  VixFdTarget *fd_target = (VixFdTarget *)data;
+
+  close_fd(&fd_target->fd);
+  g_free(fd_target);
+}
+
+ERL_NIF_TERM nif_fd_target_new(ErlNifEnv *env, int argc,
+                               const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  VixFdTarget *fd_target;
+  VipsTargetCustom *target;
+  int fd, timeout, dup_fd;
+
+  if (!enif_get_int(env, argv[0], &fd) || fd < 0) {
+    return make_error(env, "fd must be a non-negative integer");
+  }
+
+  if (!enif_get_int(env, argv[1], &timeout) || timeout < -1) {
+    return make_error(env, "timeout must be a non-negative integer or -1");
+  }
+
+  dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd == -1) {
+    return make_error(env, strerror(errno));
+  }
+
+  fd_target = g_new(VixFdTarget, 1);
+  fd_target->fd = dup_fd;
+  fd_target->timeout = timeout;
+
+  target = vips_target_custom_new();
+
+  g_signal_connect(target, "write", G_CALLBACK(fd_target_on_write),
+                   fd_target);
+#if (VIPS_MAJOR_VERSION < 8) ||                                                \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION < 13)
+  g_signal_connect(target, "finish", G_CALLBACK(fd_target_on_finish),
+                   fd_target);
+#else
+  g_signal_connect(target, "end", G_CALLBACK(fd_target_on_end), fd_target);
+#endif
+  g_object_weak_ref(G_OBJECT(target), fd_target_on_target_dispose,
+                    fd_target);
+
+  return make_ok(env, g_object_to_erl_term(env, (GObject *)target));
+}
@@ -0,0 +1,9 @@
+#ifndef VIX_FD_TARGET_H
+#define VIX_FD_TARGET_H
+
+#include "erl_nif.h"
+
+ERL_NIF_TERM nif_fd_target_new(ErlNifEnv *env, int argc,
+                               const ERL_NIF_TERM argv[]);
+
+#endif
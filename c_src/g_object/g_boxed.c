@@ -1,14 +1,14 @@
 #include <glib-object.h>
+#include <vips/vips.h>
 
 #include "../utils.h"
 
+#include "../janitor.h"
 #include "g_boxed.h"
 #include "g_object.h"
 
 ErlNifResourceType *G_BOXED_RT;
 
-static ERL_NIF_TERM ATOM_UNREF_GBOXED;
-
 bool erl_term_to_g_boxed(ErlNifEnv *env, ERL_NIF_TERM term, gpointer *ptr) {
   GBoxedResource *boxed_r = NULL;
 
@@ -31,26 +31,6 @@ bool erl_term_boxed_type(ErlNifEnv *env, ERL_NIF_TERM term, GType *type) {
   return false;
 }
 
-ERL_NIF_TERM nif_g_boxed_unref(ErlNifEnv *env, int argc,
-                               const ERL_NIF_TERM argv[]) {
-  ASSERT_ARGC(argc, 1);
-
-  GBoxedResource *gboxed_r = NULL;
-
-  if (!enif_get_resource(env, argv[0], G_BOXED_RT, (void **)&gboxed_r)) {
-    // This should never happen, since g_boxed_unref is an internal call
-    return ATOM_ERROR;
-  }
-
-  g_boxed_free(gboxed_r->boxed_type, gboxed_r->boxed_ptr);
-
-  gboxed_r->boxed_ptr = NULL;
-
-  debug("GBoxed unref");
-
-  return ATOM_OK;
-}
-
 ERL_NIF_TERM boxed_to_erl_term(ErlNifEnv *env, gpointer ptr, GType type) {
   ERL_NIF_TERM term;
   GBoxedResource *boxed_r;
@@ -68,29 +48,29 @@ ERL_NIF_TERM boxed_to_erl_term(ErlNifEnv *env, gpointer ptr, GType type) {
   return term;
 }
 
+/* Boxed types whose free is only a g_free() of a small allocation,
+ * these are cheap enough to be freed directly in the destructor.
+ * Arrays of images and blobs can run arbitrary free callbacks and
+ * are always deferred */
+static bool g_boxed_is_cheap_to_free(GType type) {
+  return type == VIPS_TYPE_ARRAY_INT || type == VIPS_TYPE_ARRAY_DOUBLE ||
+         type == VIPS_TYPE_REF_STRING;
+}
+
 static void g_boxed_dtor(ErlNifEnv *env, void *obj) {
-  GBoxedResource *orig_boxed_r = (GBoxedResource *)obj;
+  GBoxedResource *boxed_r = (GBoxedResource *)obj;
 
   /*
-   * Safely unref objects using the janitor process.
-   * See g_object_dtor() for details
+   * Free on the janitor thread, see g_object_dtor() for details
    */
-  if (orig_boxed_r->boxed_ptr != NULL) {
-    GBoxedResource *temp_gboxed_r = NULL;
-    ERL_NIF_TERM temp_term;
-
-    temp_gboxed_r = enif_alloc_resource(G_BOXED_RT, sizeof(GBoxedResource));
-    temp_gboxed_r->boxed_ptr = orig_boxed_r->boxed_ptr;
-    temp_gboxed_r->boxed_type = orig_boxed_r->boxed_type;
-
-    temp_term = enif_make_resource(env, temp_gboxed_r);
-    enif_release_resource(temp_gboxed_r);
-
-    send_to_janitor(env, ATOM_UNREF_GBOXED, temp_term);
-
-    debug("GBoxedResource is sent to janitor process");
-  } else {
+  if (boxed_r->boxed_ptr == NULL) {
     debug("GBoxedResource is already unset");
+  } else if (g_boxed_is_cheap_to_free(boxed_r->boxed_type)) {
+    g_boxed_free(boxed_r->boxed_type, boxed_r->boxed_ptr);
+    boxed_r->boxed_ptr = NULL;
+  } else {
+    janitor_free_g_boxed(boxed_r->boxed_type, boxed_r->boxed_ptr);
+    boxed_r->boxed_ptr = NULL;
   }
 }
 
@@ -104,7 +84,5 @@ int nif_g_boxed_init(ErlNifEnv *env) {
     return 1;
   }
 
-  ATOM_UNREF_GBOXED = make_atom(env, "unref_gboxed");
-
   return 0;
 }
@@ -1,12 +1,18 @@
 #include <glib-object.h>
+#include <vips/vips.h>
 
 #include "../utils.h"
 
+#include "../janitor.h"
 #include "g_object.h"
 
 ErlNifResourceType *G_OBJECT_RT;
 
-static ERL_NIF_TERM ATOM_UNREF_GOBJECT;
+/* References taken on the objects looked up by the running NIF, see
+ * `g_object_resource_get` */
+static GPrivate call_refs = G_PRIVATE_INIT((GDestroyNotify)g_ptr_array_unref);
+
+static void unref_g_object(GObject *obj);
 
 // Ownership is transferred to beam, `obj` must *not* be freed
 // by the caller
@@ -19,6 +25,8 @@ ERL_NIF_TERM g_object_to_erl_term(ErlNifEnv *env, GObject *obj) {
   // TODO: Keep gtype name and use elixir-struct instead of c-struct,
   // so that type information is visible in elixir.
   gobject_r->obj = obj;
+  g_mutex_init(&gobject_r->lock);
+  gobject_r->image_header.ready = 0;
 
   term = enif_make_resource(env, gobject_r);
   enif_release_resource(gobject_r);
@@ -38,82 +46,138 @@ ERL_NIF_TERM nif_g_object_type_name(ErlNifEnv *env, int argc,
   return make_binary(env, G_OBJECT_TYPE_NAME(obj));
 }
 
-ERL_NIF_TERM nif_g_object_unref(ErlNifEnv *env, int argc,
-                                const ERL_NIF_TERM argv[]) {
+/* Drops the reference of the term, any call taking it fails
+ * afterwards. NIFs hold their own reference on the objects they use,
+ * so the object is freed as soon as the calls already running return,
+ * unless libvips still references it, e.g. from the operation cache */
+ERL_NIF_TERM nif_g_object_release(ErlNifEnv *env, int argc,
+                                  const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
 
   GObjectResource *gobject_r = NULL;
+  GObject *obj;
 
-  if (!enif_get_resource(env, argv[0], G_OBJECT_RT, (void **)&gobject_r)) {
-    // This should never happen, since g_object_unref is an internal call
-    return ATOM_ERROR;
-  }
+  if (!enif_get_resource(env, argv[0], G_OBJECT_RT, (void **)&gobject_r))
+    return enif_make_badarg(env);
 
-  g_object_unref(gobject_r->obj);
+  g_mutex_lock(&gobject_r->lock);
+  obj = gobject_r->obj;
   gobject_r->obj = NULL;
+  g_mutex_unlock(&gobject_r->lock);
 
-  debug("GObject unref");
+  if (obj)
+    unref_g_object(obj);
 
   return ATOM_OK;
 }
 
+/* Returns the object of the resource, or NULL if it was released.
+ *
+ * The caller does not own the returned reference. It is owned by the
+ * running NIF call and dropped by `g_object_release_call_refs` once the
+ * call returns, so a concurrent `nif_g_object_release` can not free the
+ * object while the call uses it.
+ */
+GObject *g_object_resource_get(GObjectResource *gobject_r) {
+  GPtrArray *refs;
+  GObject *obj;
+
+  g_mutex_lock(&gobject_r->lock);
+  obj = gobject_r->obj;
+  if (obj)
+    g_object_ref(obj);
+  g_mutex_unlock(&gobject_r->lock);
+
+  if (!obj)
+    return NULL;
+
+  refs = g_private_get(&call_refs);
+
+  if (!refs) {
+    refs = g_ptr_array_new();
+    g_private_set(&call_refs, refs);
+  }
+
+  g_ptr_array_add(refs, obj);
+
+  return obj;
+}
+
+/* Drops the references taken by `g_object_resource_get` on this thread.
+ * Called after every NIF, and after every job run outside of a NIF */
+void g_object_release_call_refs(void) {
+  GPtrArray *refs = g_private_get(&call_refs);
+
+  if (!refs)
+    return;
+
+  for (guint i = 0; i < refs->len; i++)
+    unref_g_object(g_ptr_array_index(refs, i));
+
+  g_ptr_array_set_size(refs, 0);
+}
+
 bool erl_term_to_g_object(ErlNifEnv *env, ERL_NIF_TERM term, GObject **obj) {
   GObjectResource *gobject_r = NULL;
-  if (enif_get_resource(env, term, G_OBJECT_RT, (void **)&gobject_r)) {
-    (*obj) = gobject_r->obj;
+  GObject *ptr;
+
+  if (enif_get_resource(env, term, G_OBJECT_RT, (void **)&gobject_r) &&
+      (ptr = g_object_resource_get(gobject_r))) {
+    (*obj) = ptr;
     return true;
   }
   return false;
 }
 
+bool erl_term_to_g_object_resource(ErlNifEnv *env, ERL_NIF_TERM term,
+                                   GObjectResource **gobject_r) {
+  return enif_get_resource(env, term, G_OBJECT_RT, (void **)gobject_r);
+}
+
+/* Whether dropping our reference is cheap. Interpolators hold no
+ * pixel data. For everything else only the final unref can trigger
+ * an expensive dispose, such as freeing an image and its upstream
+ * pipeline, closing a file or flushing a target.
+ *
+ * The refcount read is racy: another thread might drop its own
+ * reference before we drop ours, in which case the final unref
+ * happens inline. That is only slower, never incorrect, and rare.
+ */
+static bool g_object_is_cheap_to_unref(GObject *obj) {
+  if (VIPS_IS_INTERPOLATE(obj))
+    return true;
+
+  return g_atomic_int_get((gint *)&obj->ref_count) > 1;
+}
+
+/**
+ * The resource destructor, like most NIFs releasing references, is
+ * executed inside a normal scheduler instead of a dirty scheduler, which
+ * can cause issues if the code is time-consuming.
+ * See: https://erlangforums.com/t/4290
+ *
+ * To address this, we avoid performing time-consuming work there and
+ * offload the unref to the native janitor thread, see janitor.c. Unrefs
+ * which are known to be cheap are done inline to keep the queue short.
+ */
+static void unref_g_object(GObject *obj) {
+  if (g_object_is_cheap_to_unref(obj))
+    g_object_unref(obj);
+  else
+    janitor_unref_g_object(obj);
+}
+
 static void g_object_dtor(ErlNifEnv *env, void *ptr) {
-  GObjectResource *orig_gobject_r = (GObjectResource *)ptr;
-
-  /**
-   * The resource destructor is executed inside a normal scheduler instead of a
-   * dirty scheduler, which can cause issues if the code is time-consuming.
-   * See: https://erlangforums.com/t/4290
-   *
-   * To address this, we avoid performing time-consuming work in the destructor
-   * and offload it to a janitor process. The Janitor process then calls the
-   * time-consuming cleanup NIF code on a dirty scheduler. Since Beam
-   * deallocates the resource at the end of the `dtor` call, we must create a
-   * new resource term to pass the object to the janitor process.
-   *
-   * Resources can be of two types:
-   *
-   *   1. Normal Resource: Constructed during normal operations; the pointer to
-   * the object is never NULL in this case.
-   *
-   *   2. Internal Resource: Constructed within the `dtor` of a normal resource
-   * solely for cleanup purposes and not for image processing operations. The
-   * pointer to the object will be NULL after cleanup.
-   *
-   * Currently, we use this length approach for all `g_object` and
-   * `g_boxed` objects, including smaller types like `VipsArray` of
-   * integers or doubles. For these smaller objects, it might be more
-   * efficient to skip certain steps. However, we are deferring the
-   * implementation of such special cases to keep the code simple for
-   * now.
-   *
-   */
-  if (orig_gobject_r->obj != NULL) {
-    GObjectResource *temp_gobject_r = NULL;
-    ERL_NIF_TERM temp_term;
-
-    /* Create temporary internal resource for the cleanup */
-    temp_gobject_r = enif_alloc_resource(G_OBJECT_RT, sizeof(GObjectResource));
-    temp_gobject_r->obj = orig_gobject_r->obj;
-
-    temp_term = enif_make_resource(env, temp_gobject_r);
-    enif_release_resource(temp_gobject_r);
-    send_to_janitor(env, ATOM_UNREF_GOBJECT, temp_term);
-    debug("GObjectResource is sent to janitor process");
-  } else {
+  GObjectResource *gobject_r = (GObjectResource *)ptr;
+
+  if (gobject_r->obj == NULL) {
     debug("GObjectResource is already unset");
+  } else {
+    unref_g_object(gobject_r->obj);
+    gobject_r->obj = NULL;
   }
 
-  return;
+  g_mutex_clear(&gobject_r->lock);
 }
 
 int nif_g_object_init(ErlNifEnv *env) {
@@ -126,7 +190,5 @@ int nif_g_object_init(ErlNifEnv *env) {
     return 1;
   }
 
-  ATOM_UNREF_GOBJECT = make_atom(env, "unref_gobject");
-
   return 0;
 }
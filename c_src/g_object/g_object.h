@@ -7,8 +7,25 @@
 
 extern ErlNifResourceType *G_OBJECT_RT;
 
+/* Core header fields of a VipsImage, filled lazily by the image NIFs.
+ * They do not change once the image is built, so they can be read
+ * without going through GValue. `format` and `interpretation` are atoms,
+ * which are valid in every env. Only valid once `ready` is set */
+typedef struct _VixImageHeader {
+  gint ready;
+  int width;
+  int height;
+  int bands;
+  ERL_NIF_TERM format;
+  ERL_NIF_TERM interpretation;
+} VixImageHeader;
+
+/* `obj` is NULL once released by `nif_g_object_release`. It is only
+ * read through `g_object_resource_get`, under `lock` */
 typedef struct _GObjectResource {
   GObject *obj;
+  GMutex lock;
+  VixImageHeader image_header;
 } GObjectResource;
 
 ERL_NIF_TERM g_object_to_erl_term(ErlNifEnv *env, GObject *obj);
@@ -16,11 +33,18 @@ ERL_NIF_TERM g_object_to_erl_term(ErlNifEnv *env, GObject *obj);
 ERL_NIF_TERM nif_g_object_type_name(ErlNifEnv *env, int argc,
                                     const ERL_NIF_TERM argv[]);
 
-ERL_NIF_TERM nif_g_object_unref(ErlNifEnv *env, int argc,
-                                const ERL_NIF_TERM argv[]);
+ERL_NIF_TERM nif_g_object_release(ErlNifEnv *env, int argc,
+                                  const ERL_NIF_TERM argv[]);
 
 bool erl_term_to_g_object(ErlNifEnv *env, ERL_NIF_TERM term, GObject **obj);
 
+bool erl_term_to_g_object_resource(ErlNifEnv *env, ERL_NIF_TERM term,
+                                   GObjectResource **gobject_r);
+
+GObject *g_object_resource_get(GObjectResource *gobject_r);
+
+void g_object_release_call_refs(void);
+
 int nif_g_object_init(ErlNifEnv *env);
 
 #endif
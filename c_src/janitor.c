@@ -0,0 +1,198 @@
+#include <glib-object.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "janitor.h"
+#include "utils.h"
+
+/* Resource destructors run on normal schedulers, where the final unref
+ * of a libvips object can take too long (see
+ * https://erlangforums.com/t/4290). Destructors push the object to a
+ * queue instead, which is drained by a dedicated native thread.
+ *
+ * The queue is an intrusive multi-producer single-consumer queue
+ * (Dmitry Vyukov's design): a push is a single atomic exchange, so
+ * destructors never take a lock unless the janitor thread is asleep
+ * and needs to be woken up.
+ */
+
+typedef enum { JANITOR_G_OBJECT, JANITOR_G_BOXED } JanitorItemKind;
+
+typedef struct _JanitorItem {
+  _Atomic(struct _JanitorItem *) next;
+  JanitorItemKind kind;
+  GType boxed_type;
+  gpointer ptr;
+} JanitorItem;
+
+static struct {
+  /* producers push at head, the janitor thread pops at tail */
+  _Atomic(JanitorItem *) head;
+  JanitorItem *tail;
+  JanitorItem stub;
+  /* number of items pushed and not freed yet */
+  atomic_size_t depth;
+  /* the janitor thread sleeps on `cond` when the queue is empty */
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+} janitor;
+
+/* Maximum number of items freed between two wake-up checks */
+static const int JANITOR_BATCH_SIZE = 256;
+
+static void janitor_push(JanitorItem *item) {
+  JanitorItem *prev;
+
+  atomic_store_explicit(&item->next, NULL, memory_order_relaxed);
+  prev = atomic_exchange_explicit(&janitor.head, item, memory_order_acq_rel);
+  atomic_store_explicit(&prev->next, item, memory_order_release);
+}
+
+/* Returns NULL if the queue is empty, or if a producer is in the middle
+ * of a push. In both cases the item shows up on a later call */
+static JanitorItem *janitor_pop(void) {
+  JanitorItem *tail, *next, *head;
+
+  tail = janitor.tail;
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  if (tail == &janitor.stub) {
+    if (!next)
+      return NULL;
+
+    janitor.tail = next;
+    tail = next;
+    next = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+
+  if (next) {
+    janitor.tail = next;
+    return tail;
+  }
+
+  head = atomic_load_explicit(&janitor.head, memory_order_acquire);
+  if (tail != head)
+    return NULL;
+
+  janitor_push(&janitor.stub);
+
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next) {
+    janitor.tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+static void janitor_enqueue(JanitorItem *item) {
+  size_t depth;
+
+  // counted before the push so that depth never goes below zero
+  depth = atomic_fetch_add(&janitor.depth, 1);
+  janitor_push(item);
+
+  // wake up the janitor thread only if it may be waiting
+  if (depth == 0) {
+    enif_mutex_lock(janitor.lock);
+    enif_cond_signal(janitor.cond);
+    enif_mutex_unlock(janitor.lock);
+  }
+}
+
+static void janitor_free_item(JanitorItem *item) {
+  switch (item->kind) {
+  case JANITOR_G_OBJECT:
+    g_object_unref(item->ptr);
+    debug("GObject unref");
+    break;
+  case JANITOR_G_BOXED:
+    g_boxed_free(item->boxed_type, item->ptr);
+    debug("GBoxed unref");
+    break;
+  }
+
+  g_free(item);
+}
+
+static gpointer janitor_thread(gpointer data) {
+  JanitorItem *item;
+  int freed;
+
+  while (true) {
+    freed = 0;
+
+    while (freed < JANITOR_BATCH_SIZE && (item = janitor_pop())) {
+      janitor_free_item(item);
+      freed++;
+    }
+
+    if (freed > 0) {
+      atomic_fetch_sub(&janitor.depth, (size_t)freed);
+      continue;
+    }
+
+    enif_mutex_lock(janitor.lock);
+    if (atomic_load(&janitor.depth) == 0)
+      enif_cond_wait(janitor.cond, janitor.lock);
+    enif_mutex_unlock(janitor.lock);
+
+    // a push in progress is not visible yet
+    if (atomic_load(&janitor.depth) > 0)
+      g_thread_yield();
+  }
+
+  return NULL;
+}
+
+void janitor_unref_g_object(GObject *obj) {
+  JanitorItem *item = g_new(JanitorItem, 1);
+
+  item->kind = JANITOR_G_OBJECT;
+  item->ptr = obj;
+  janitor_enqueue(item);
+}
+
+void janitor_free_g_boxed(GType type, gpointer ptr) {
+  JanitorItem *item = g_new(JanitorItem, 1);
+
+  item->kind = JANITOR_G_BOXED;
+  item->boxed_type = type;
+  item->ptr = ptr;
+  janitor_enqueue(item);
+}
+
+ERL_NIF_TERM nif_janitor_queue_depth(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 0);
+  return enif_make_uint64(env, atomic_load(&janitor.depth));
+}
+
+int nif_janitor_init(ErlNifEnv *env) {
+  GThread *thread;
+
+  atomic_store(&janitor.stub.next, NULL);
+  atomic_store(&janitor.head, &janitor.stub);
+  janitor.tail = &janitor.stub;
+  atomic_store(&janitor.depth, 0);
+
+  janitor.lock = enif_mutex_create("vix_janitor_lock");
+  janitor.cond = enif_cond_create("vix_janitor_cond");
+
+  if (!janitor.lock || !janitor.cond) {
+    error("Failed to create janitor lock");
+    return 1;
+  }
+
+  // runs for the lifetime of the VM, like the libvips worker threads
+  thread = g_thread_try_new("vix-janitor", janitor_thread, NULL, NULL);
+  if (!thread) {
+    error("Failed to start janitor thread");
+    return 1;
+  }
+
+  g_thread_unref(thread);
+
+  return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef VIX_JANITOR_H
+#define VIX_JANITOR_H
+
+#include "erl_nif.h"
+#include <glib-object.h>
+
+void janitor_unref_g_object(GObject *obj);
+
+void janitor_free_g_boxed(GType type, gpointer ptr);
+
+ERL_NIF_TERM nif_janitor_queue_depth(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]);
+
+int nif_janitor_init(ErlNifEnv *env);
+
+#endif
@@ -0,0 +1,325 @@
+#include <glib-object.h>
+#include <string.h>
+#include <vips/vips.h>
+
+#include "load_index.h"
+#include "utils.h"
+
+/* `vips_foreign_find_load_buffer` and `_source` run the `is_a` check
+ * of every loader in turn until one matches. For the common formats
+ * the leading bytes are enough to pick the loader, so they are looked
+ * up in a trie of magic bytes first, and only the `is_a` check of that
+ * loader is run to confirm. Anything the trie does not know, or which
+ * the loader rejects, goes through the full search.
+ *
+ * The trie is built once at load time. The full search tries loaders
+ * in priority order, so an entry is only added if every loader tried
+ * before it is known to reject its bytes: a loader with signatures of
+ * its own, none of which overlap. Any other loader ahead of it, such as
+ * `openslideload` ahead of `tiffload`, keeps the signature out of the
+ * trie, and those bytes go through the full search.
+ */
+
+#define SIGNATURE_MAX_LENGTH 12
+#define ANY_BYTE 256
+#define MAX_NODES 96
+
+typedef struct _LoadSignature {
+  const char *loader;
+  int length;
+  /* byte values, or ANY_BYTE */
+  int bytes[SIGNATURE_MAX_LENGTH];
+} LoadSignature;
+
+/* clang-format off */
+static const LoadSignature SIGNATURES[] = {
+  {"jpegload", 3, {0xFF, 0xD8, 0xFF}},
+  {"pngload", 8, {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'}},
+  {"gifload", 6, {'G', 'I', 'F', '8', '7', 'a'}},
+  {"gifload", 6, {'G', 'I', 'F', '8', '9', 'a'}},
+  {"webpload", 12, {'R', 'I', 'F', 'F', ANY_BYTE, ANY_BYTE, ANY_BYTE,
+                    ANY_BYTE, 'W', 'E', 'B', 'P'}},
+  {"tiffload", 4, {'I', 'I', '*', 0}},
+  {"tiffload", 4, {'M', 'M', 0, '*'}},
+  {"heifload", 8, {ANY_BYTE, ANY_BYTE, ANY_BYTE, ANY_BYTE,
+                   'f', 't', 'y', 'p'}},
+  {"jxlload", 2, {0xFF, 0x0A}},
+  {"jxlload", 8, {0, 0, 0, 0x0C, 'J', 'X', 'L', ' '}},
+  {"jp2kload", 8, {0, 0, 0, 0x0C, 'j', 'P', ' ', ' '}},
+  {"jp2kload", 4, {0xFF, 0x4F, 0xFF, 0x51}},
+  {"pdfload", 4, {'%', 'P', 'D', 'F'}},
+  {"vipsload", 4, {0x08, 0xF2, 0xA6, 0xB6}},
+  {"vipsload", 4, {0xB6, 0xA6, 0xF2, 0x08}},
+};
+/* clang-format on */
+
+typedef struct _LoadIndexEntry {
+  VipsForeignLoadClass *buffer_class;
+  VipsForeignLoadClass *source_class;
+} LoadIndexEntry;
+
+typedef struct _LoadIndexNode {
+  /* index of the child node for each byte value and ANY_BYTE, 0 if none */
+  guint8 next[ANY_BYTE + 1];
+  /* entry of the signature ending at this node, -1 if none */
+  int entry;
+} LoadIndexNode;
+
+static LoadIndexNode nodes[MAX_NODES];
+static int nodes_count = 0;
+
+static LoadIndexEntry entries[G_N_ELEMENTS(SIGNATURES)];
+static int entries_count = 0;
+
+static GType find_load_type(const char *loader, const char *suffix) {
+  char nickname[64];
+
+  g_snprintf(nickname, sizeof(nickname), "%s%s", loader, suffix);
+
+  return vips_type_find("VipsForeignLoad", nickname);
+}
+
+static VipsForeignLoadClass *find_load_class(const char *loader,
+                                             const char *suffix) {
+  GType type = find_load_type(loader, suffix);
+
+  if (type == 0)
+    return NULL;
+
+  // never unref'ed, loader classes live as long as libvips
+  return VIPS_FOREIGN_LOAD_CLASS(g_type_class_ref(type));
+}
+
+static bool signatures_overlap(const LoadSignature *a,
+                               const LoadSignature *b) {
+  for (int i = 0; i < MIN(a->length, b->length); i++) {
+    if (a->bytes[i] != ANY_BYTE && b->bytes[i] != ANY_BYTE &&
+        a->bytes[i] != b->bytes[i])
+      return false;
+  }
+
+  return true;
+}
+
+/* Whether the loader named `nickname` is known to reject bytes starting
+ * with `signature`, that is it has signatures and none of them overlap */
+static bool rejects_signature(const char *nickname, const char *suffix,
+                              const LoadSignature *signature) {
+  size_t length = strlen(nickname) - strlen(suffix);
+  bool known = false;
+
+  for (size_t i = 0; i < G_N_ELEMENTS(SIGNATURES); i++) {
+    if (strlen(SIGNATURES[i].loader) != length ||
+        strncmp(SIGNATURES[i].loader, nickname, length) != 0)
+      continue;
+
+    known = true;
+
+    if (signatures_overlap(&SIGNATURES[i], signature))
+      return false;
+  }
+
+  return known;
+}
+
+typedef struct _PrecedenceCheck {
+  VipsForeignLoadClass *load_class;
+  const LoadSignature *signature;
+  const char *suffix;
+  bool buffer;
+  /* a loader tried before `load_class` which may claim the bytes */
+  const char *claimed_by;
+} PrecedenceCheck;
+
+/* `vips_foreign_map` visits the loaders in the order the full search
+ * tries them, stops at the indexed loader or at one which may claim the
+ * signature before it */
+static void *check_precedence_cb(VipsForeignLoadClass *load_class, void *a,
+                                 void *b) {
+  PrecedenceCheck *check = (PrecedenceCheck *)a;
+  const char *nickname = VIPS_OBJECT_CLASS(load_class)->nickname;
+
+  if (load_class == check->load_class)
+    return load_class;
+
+  if (!g_str_has_suffix(nickname, check->suffix))
+    return NULL;
+
+  if (check->buffer ? !load_class->is_a_buffer : !load_class->is_a_source)
+    return NULL;
+
+  if (rejects_signature(nickname, check->suffix, check->signature))
+    return NULL;
+
+  check->claimed_by = nickname;
+  return load_class;
+}
+
+/* Returns the loader class for the signature, NULL if the loader is not
+ * available or if the full search might pick another loader first */
+static VipsForeignLoadClass *find_index_class(const LoadSignature *signature,
+                                              const char *suffix) {
+  PrecedenceCheck check = {0};
+
+  check.load_class = find_load_class(signature->loader, suffix);
+  if (!check.load_class)
+    return NULL;
+
+  check.signature = signature;
+  check.suffix = suffix;
+  check.buffer = strcmp(suffix, "_buffer") == 0;
+
+  (void)vips_foreign_map("VipsForeignLoad",
+                         (VipsSListMap2Fn)check_precedence_cb, &check, NULL);
+
+  if (check.claimed_by) {
+    debug("%s%s may be claimed by %s first, not indexed", signature->loader,
+          suffix, check.claimed_by);
+    return NULL;
+  }
+
+  return check.load_class;
+}
+
+static int new_node(void) {
+  LoadIndexNode *node;
+
+  if (nodes_count == MAX_NODES)
+    return -1;
+
+  node = &nodes[nodes_count];
+  memset(node->next, 0, sizeof(node->next));
+  node->entry = -1;
+
+  return nodes_count++;
+}
+
+static void insert_signature(const LoadSignature *signature, int entry) {
+  int node = 0, child, byte;
+
+  for (int i = 0; i < signature->length; i++) {
+    byte = signature->bytes[i];
+    child = nodes[node].next[byte];
+
+    if (child == 0) {
+      child = new_node();
+
+      if (child < 0) {
+        error("load index is full, ignoring %s", signature->loader);
+        return;
+      }
+
+      nodes[node].next[byte] = (guint8)child;
+    }
+
+    node = child;
+  }
+
+  nodes[node].entry = entry;
+}
+
+/* Returns the entry of the longest signature matching `data`, -1 if
+ * none. Signatures are short and there is a single wildcard run, so a
+ * depth-first walk is cheap */
+static int lookup(int node, const unsigned char *data, size_t size,
+                  int depth, int *best_depth) {
+  int found = -1, ret;
+
+  if (nodes[node].entry >= 0 && depth > *best_depth) {
+    found = nodes[node].entry;
+    *best_depth = depth;
+  }
+
+  if ((size_t)depth >= size)
+    return found;
+
+  if (nodes[node].next[data[depth]]) {
+    ret = lookup(nodes[node].next[data[depth]], data, size, depth + 1,
+                 best_depth);
+    if (ret >= 0)
+      found = ret;
+  }
+
+  if (nodes[node].next[ANY_BYTE]) {
+    ret = lookup(nodes[node].next[ANY_BYTE], data, size, depth + 1,
+                 best_depth);
+    if (ret >= 0)
+      found = ret;
+  }
+
+  return found;
+}
+
+static bool is_blocked(VipsForeignLoadClass *load_class) {
+#if (VIPS_MAJOR_VERSION < 8) ||                                                \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION < 13)
+  return false;
+#else
+  return VIPS_OPERATION_CLASS(load_class)->flags & VIPS_OPERATION_BLOCKED;
+#endif
+}
+
+const char *load_index_find_buffer(const void *data, size_t size) {
+  VipsForeignLoadClass *load_class;
+  int best_depth = -1, entry;
+
+  entry = lookup(0, data, size, 0, &best_depth);
+  if (entry < 0)
+    return NULL;
+
+  load_class = entries[entry].buffer_class;
+
+  if (!load_class || !load_class->is_a_buffer || is_blocked(load_class) ||
+      !load_class->is_a_buffer(data, size))
+    return NULL;
+
+  return G_OBJECT_CLASS_NAME(load_class);
+}
+
+const char *load_index_find_source(VipsSource *source) {
+  VipsForeignLoadClass *load_class;
+  unsigned char *data;
+  gint64 size;
+  int best_depth = -1, entry;
+
+  size = vips_source_sniff_at_most(source, &data, SIGNATURE_MAX_LENGTH);
+  if (size <= 0)
+    return NULL;
+
+  entry = lookup(0, data, (size_t)size, 0, &best_depth);
+  if (entry < 0)
+    return NULL;
+
+  load_class = entries[entry].source_class;
+
+  if (!load_class || !load_class->is_a_source || is_blocked(load_class) ||
+      !load_class->is_a_source(source))
+    return NULL;
+
+  return G_OBJECT_CLASS_NAME(load_class);
+}
+
+int load_index_init(void) {
+  const LoadSignature *signature;
+  LoadIndexEntry *entry;
+
+  nodes_count = 0;
+  entries_count = 0;
+  new_node();
+
+  for (size_t i = 0; i < G_N_ELEMENTS(SIGNATURES); i++) {
+    signature = &SIGNATURES[i];
+
+    entry = &entries[entries_count];
+    entry->buffer_class = find_index_class(signature, "_buffer");
+    entry->source_class = find_index_class(signature, "_source");
+
+    if (!entry->buffer_class && !entry->source_class)
+      continue;
+
+    insert_signature(signature, entries_count);
+    entries_count++;
+  }
+
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef VIX_LOAD_INDEX_H
+#define VIX_LOAD_INDEX_H
+
+#include <stddef.h>
+#include <vips/vips.h>
+
+const char *load_index_find_buffer(const void *data, size_t size);
+
+const char *load_index_find_source(VipsSource *source);
+
+int load_index_init(void);
+
+#endif
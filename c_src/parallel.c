@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <vips/vips.h>
+
+#include "parallel.h"
+#include "utils.h"
+
+/* Batched NIFs split their work across native threads. Instead of
+ * starting threads on each call, helpers come from one pool shared by
+ * all callers, sized to the libvips concurrency, so concurrent calls do
+ * not oversubscribe the CPUs.
+ *
+ * A helper which starts after the caller has finished the work itself,
+ * because the pool was busy, returns without touching the work. The job
+ * is freed by whichever of the caller and the helpers is the last one */
+
+typedef struct _VixParallelJob {
+  GThreadFunc worker;
+  gpointer data;
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+  guint running;
+  bool finished;
+  gint ref_count;
+} VixParallelJob;
+
+static GThreadPool *helper_pool;
+
+static void parallel_job_unref(VixParallelJob *job) {
+  if (!g_atomic_int_dec_and_test(&job->ref_count))
+    return;
+
+  enif_cond_destroy(job->cond);
+  enif_mutex_destroy(job->lock);
+  g_free(job);
+}
+
+static void run_helper(gpointer data, gpointer user_data) {
+  VixParallelJob *job = (VixParallelJob *)data;
+
+  enif_mutex_lock(job->lock);
+
+  if (job->finished) {
+    enif_mutex_unlock(job->lock);
+    parallel_job_unref(job);
+    return;
+  }
+
+  job->running++;
+  enif_mutex_unlock(job->lock);
+
+  job->worker(job->data);
+
+  enif_mutex_lock(job->lock);
+  job->running--;
+  enif_cond_signal(job->cond);
+  enif_mutex_unlock(job->lock);
+
+  parallel_job_unref(job);
+}
+
+void parallel_run(GThreadFunc worker, gpointer data, guint n_helpers) {
+  VixParallelJob *job;
+  guint pushed = 0;
+
+  job = g_new0(VixParallelJob, 1);
+  job->worker = worker;
+  job->data = data;
+  job->lock = enif_mutex_create("vix_parallel_job_lock");
+  job->cond = enif_cond_create("vix_parallel_job_cond");
+  job->ref_count = (gint)n_helpers + 1;
+
+  for (; pushed < n_helpers; pushed++) {
+    if (!g_thread_pool_push(helper_pool, job, NULL))
+      break;
+  }
+
+  // helpers which could not be queued
+  for (guint i = pushed; i < n_helpers; i++)
+    parallel_job_unref(job);
+
+  worker(data);
+
+  enif_mutex_lock(job->lock);
+  job->finished = true;
+
+  while (job->running > 0)
+    enif_cond_wait(job->cond, job->lock);
+
+  enif_mutex_unlock(job->lock);
+
+  parallel_job_unref(job);
+}
+
+int parallel_init(void) {
+  GError *err = NULL;
+
+  helper_pool = g_thread_pool_new(run_helper, NULL, vips_concurrency_get(),
+                                  FALSE, &err);
+
+  if (!helper_pool) {
+    error("Failed to create helper pool. error: %s", err->message);
+    g_error_free(err);
+    return 1;
+  }
+
+  return 0;
+}
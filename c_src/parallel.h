@@ -0,0 +1,14 @@
+#ifndef VIX_PARALLEL_H
+#define VIX_PARALLEL_H
+
+#include <glib.h>
+
+/* Runs `worker(data)` on the calling thread and on up to `n_helpers`
+ * threads of the shared helper pool, and returns once every started
+ * worker has returned. Workers must pick pending work from `data`
+ * until none is left, the calling thread alone is enough to finish */
+void parallel_run(GThreadFunc worker, gpointer data, guint n_helpers);
+
+int parallel_init(void);
+
+#endif
@@ -1,3 +1,6 @@
+/* F_SETPIPE_SZ is Linux specific */
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
 #include <glib-object.h>
@@ -14,9 +17,14 @@
 
 static ErlNifResourceType *FD_RT;
 
-/* TargetPipe reads are chunked; cap one read to avoid huge NIF allocations. */
+/* Reads are chunked; cap one read to avoid huge NIF allocations. */
 static const int MAX_READ_BUFFER_SIZE = 64 * 1024 * 1024;
 
+#ifdef F_SETPIPE_SZ
+/* Pipes default to 64KiB on Linux, which means a round trip per 64KiB */
+static const int PIPE_SIZE = 1024 * 1024;
+#endif
+
 typedef struct {
   int fd;
   /*
@@ -80,6 +88,15 @@ static int set_cloexec_nonblock(int fd) {
   return set_nonblock(fd);
 }
 
+static void set_pipe_size(int fd) {
+#ifdef F_SETPIPE_SZ
+  // best effort, the size is capped by /proc/sys/fs/pipe-max-size
+  if (fcntl(fd, F_SETPIPE_SZ, PIPE_SIZE) == -1) {
+    debug("failed to set pipe size: %s", strerror(errno));
+  }
+#endif
+}
+
 static void close_pipes(int pipes[2]) {
   for (int i = 0; i < 2; i++) {
     close_fd(&pipes[i]);
@@ -147,6 +164,8 @@ ERL_NIF_TERM nif_source_new(ErlNifEnv *env, int argc,
     goto exit;
   }
 
+  set_pipe_size(fds[1]);
+
   if (set_cloexec(fds[0]) < 0 ||
       set_cloexec_nonblock(fds[1]) < 0) {
     ret = make_error(env, "failed to set flags to fd");
@@ -205,6 +224,8 @@ ERL_NIF_TERM nif_target_new(ErlNifEnv *env, int argc,
     goto exit;
   }
 
+  set_pipe_size(fds[1]);
+
   if (set_cloexec_nonblock(fds[0]) < 0 ||
       set_cloexec(fds[1]) < 0) {
     ret = make_error(env, "failed to set flags to fd");
@@ -266,6 +287,8 @@ ERL_NIF_TERM nif_pipe_open(ErlNifEnv *env, int argc,
     goto exit;
   }
 
+  set_pipe_size(fds[1]);
+
   if (strcmp(mode, "read") == 0) {
     if (set_cloexec_nonblock(fds[0]) < 0 ||
         set_cloexec(fds[1]) < 0) {
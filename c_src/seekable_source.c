@@ -0,0 +1,307 @@
+#include <glib-object.h>
+#include <stdio.h>
+#include <string.h>
+#include <vips/vips.h>
+
+#include "g_object/g_object.h"
+#include "seekable_source.h"
+#include "utils.h"
+
+/* A seekable source serves the reads of a loader from an Erlang
+ * process implementing `Vix.Vips.SeekableSource`. Seeks only move the
+ * position kept here, and every read is sent to the server process as
+ * `{ref, :read, id, offset, length}`. The calling thread blocks until
+ * the server answers with `nif_seekable_source_reply/3`. A single read
+ * is in flight at a time, other readers wait for their turn.
+ *
+ * Since the source can seek, libvips does not buffer the whole input
+ * for loaders which need random access, only the ranges they read are
+ * requested.
+ *
+ * The server is sent `{ref, :close}` once the source is released. If
+ * the server exits, pending and future reads fail.
+ */
+
+static ErlNifResourceType *SEEKABLE_SOURCE_RT;
+
+static void seekable_source_rt_dtor(ErlNifEnv *env, void *obj) {
+  VixSeekableSource *stream = (VixSeekableSource *)obj;
+
+  debug("VixSeekableSource seekable_source_rt_dtor called");
+
+  if (stream->ref_env)
+    enif_free_env(stream->ref_env);
+
+  if (stream->cond)
+    enif_cond_destroy(stream->cond);
+
+  if (stream->lock)
+    enif_mutex_destroy(stream->lock);
+}
+
+static void seekable_source_rt_down(ErlNifEnv *env, void *obj,
+                                    ErlNifPid *pid, ErlNifMonitor *monitor) {
+  VixSeekableSource *stream = (VixSeekableSource *)obj;
+
+  debug("seekable source server is down");
+
+  enif_mutex_lock(stream->lock);
+  stream->closed = true;
+  enif_cond_broadcast(stream->cond);
+  enif_mutex_unlock(stream->lock);
+}
+
+/* must be called with the lock held */
+static bool seekable_source_send(VixSeekableSource *stream, ErlNifEnv *msg_env,
+                                 ERL_NIF_TERM msg) {
+  // called from threads which are not bound to a process
+  if (!enif_send(NULL, &stream->server, msg_env, msg)) {
+    stream->closed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static gint64 seekable_source_on_read(VipsSourceCustom *source, void *buffer,
+                                      gint64 length, VixSeekableSource *stream) {
+  ErlNifEnv *msg_env;
+  ERL_NIF_TERM msg;
+  gint64 result = -1;
+  char read_error[sizeof(stream->read_error)] = "source is closed";
+
+  enif_mutex_lock(stream->lock);
+
+  // libvips can read from several threads, requests go one at a time
+  while (stream->busy && !stream->closed)
+    enif_cond_wait(stream->cond, stream->lock);
+
+  if (stream->closed)
+    goto exit;
+
+  stream->busy = true;
+  stream->request_id++;
+  stream->pending = true;
+  stream->read_buffer = buffer;
+  stream->read_length = length;
+  stream->read_result = -1;
+  stream->read_error[0] = '\0';
+
+  msg_env = enif_alloc_env();
+  msg = enif_make_tuple5(msg_env, enif_make_copy(msg_env, stream->ref),
+                         make_atom(msg_env, "read"),
+                         enif_make_uint64(msg_env, stream->request_id),
+                         enif_make_int64(msg_env, stream->position),
+                         enif_make_int64(msg_env, length));
+
+  if (seekable_source_send(stream, msg_env, msg)) {
+    while (stream->pending && !stream->closed)
+      enif_cond_wait(stream->cond, stream->lock);
+  }
+
+  enif_free_env(msg_env);
+
+  if (!stream->pending) {
+    result = stream->read_result;
+
+    if (result > 0)
+      stream->position += result;
+    else if (result < 0)
+      g_strlcpy(read_error, stream->read_error, sizeof(read_error));
+  }
+
+  stream->pending = false;
+  stream->read_buffer = NULL;
+  stream->busy = false;
+  enif_cond_broadcast(stream->cond);
+
+exit:
+  enif_mutex_unlock(stream->lock);
+
+  if (result < 0)
+    vips_error("VixSeekableSource", "read failed: %s", read_error);
+
+  return result;
+}
+
+static gint64 seekable_source_on_seek(VipsSourceCustom *source, gint64 offset,
+                                      int whence, VixSeekableSource *stream) {
+  gint64 position;
+
+  enif_mutex_lock(stream->lock);
+
+  switch (whence) {
+  case SEEK_SET:
+    position = offset;
+    break;
+  case SEEK_CUR:
+    position = stream->position + offset;
+    break;
+  case SEEK_END:
+    position = stream->size < 0 ? -1 : stream->size + offset;
+    break;
+  default:
+    position = -1;
+  }
+
+  if (position >= 0)
+    stream->position = position;
+
+  enif_mutex_unlock(stream->lock);
+
+  return position;
+}
+
+static void seekable_source_on_source_dispose(gpointer data,
+                                              GObject *where_the_object_was) {
+  VixSeekableSource *stream = (VixSeekableSource *)data;
+  ErlNifEnv *msg_env;
+
+  enif_mutex_lock(stream->lock);
+
+  if (!stream->closed) {
+    msg_env = enif_alloc_env();
+    seekable_source_send(
+        stream, msg_env,
+        enif_make_tuple2(msg_env, enif_make_copy(msg_env, stream->ref),
+                         make_atom(msg_env, "close")));
+    enif_free_env(msg_env);
+    stream->closed = true;
+  }
+
+  enif_mutex_unlock(stream->lock);
+
+  enif_release_resource(stream);
+}
+
+static bool get_seekable_source(ErlNifEnv *env, ERL_NIF_TERM term,
+                                VixSeekableSource **stream) {
+  return enif_get_resource(env, term, SEEKABLE_SOURCE_RT, (void **)stream);
+}
+
+ERL_NIF_TERM nif_seekable_source_new(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixSeekableSource *stream;
+  VipsSourceCustom *source;
+  ERL_NIF_TERM ret, source_term;
+  ErlNifSInt64 size;
+
+  if (!enif_get_int64(env, argv[0], &size)) {
+    return make_error(env, "size must be an integer");
+  }
+
+  stream =
+      enif_alloc_resource(SEEKABLE_SOURCE_RT, sizeof(VixSeekableSource));
+  memset(stream, 0, sizeof(VixSeekableSource));
+
+  stream->size = size < 0 ? -1 : size;
+  stream->lock = enif_mutex_create("vix_seekable_source_lock");
+  stream->cond = enif_cond_create("vix_seekable_source_cond");
+  stream->ref_env = enif_alloc_env();
+  stream->ref = enif_make_ref(stream->ref_env);
+
+  if (!stream->lock || !stream->cond) {
+    ret = make_error(env, "failed to create seekable source lock");
+    goto exit;
+  }
+
+  if (!enif_self(env, &stream->server) ||
+      enif_monitor_process(env, stream, &stream->server, NULL) != 0) {
+    ret = make_error(env, "failed to monitor seekable source server");
+    goto exit;
+  }
+
+  source = vips_source_custom_new();
+
+  g_signal_connect(source, "read", G_CALLBACK(seekable_source_on_read),
+                   stream);
+  g_signal_connect(source, "seek", G_CALLBACK(seekable_source_on_seek),
+                   stream);
+
+  // the source can outlive every term referring to the stream
+  enif_keep_resource(stream);
+  g_object_weak_ref(G_OBJECT(source), seekable_source_on_source_dispose,
+                    stream);
+
+  source_term = g_object_to_erl_term(env, (GObject *)source);
+
+  ret = make_ok(env, enif_make_tuple3(env, enif_make_resource(env, stream),
+                                      enif_make_copy(env, stream->ref),
+                                      source_term));
+
+exit:
+  enif_release_resource(stream);
+  return ret;
+}
+
+ERL_NIF_TERM nif_seekable_source_reply(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 3);
+
+  VixSeekableSource *stream;
+  ErlNifUInt64 request_id;
+  ErlNifBinary bin;
+  const ERL_NIF_TERM *tuple;
+  int arity;
+  ERL_NIF_TERM ret;
+
+  if (!get_seekable_source(env, argv[0], &stream)) {
+    return make_error(env, "failed to get seekable source");
+  }
+
+  if (!enif_get_uint64(env, argv[1], &request_id)) {
+    return make_error(env, "failed to get request id");
+  }
+
+  enif_mutex_lock(stream->lock);
+
+  if (!stream->pending || stream->request_id != request_id) {
+    ret = make_error(env, "no such read request");
+    goto exit;
+  }
+
+  if (enif_is_identical(argv[2], make_atom(env, "eof"))) {
+    stream->read_result = 0;
+  } else if (enif_get_tuple(env, argv[2], &arity, &tuple) && arity == 2 &&
+             enif_is_identical(tuple[0], ATOM_ERROR)) {
+    enif_snprintf(stream->read_error, sizeof(stream->read_error), "%T",
+                  tuple[1]);
+    stream->read_result = -1;
+  } else if (!enif_inspect_iolist_as_binary(env, argv[2], &bin)) {
+    g_strlcpy(stream->read_error, "invalid reply",
+              sizeof(stream->read_error));
+    stream->read_result = -1;
+  } else if ((gint64)bin.size > stream->read_length) {
+    error("seekable source returned more bytes than requested");
+    g_strlcpy(stream->read_error, "more bytes than requested",
+              sizeof(stream->read_error));
+    stream->read_result = -1;
+  } else {
+    memcpy(stream->read_buffer, bin.data, bin.size);
+    stream->read_result = bin.size;
+  }
+
+  stream->pending = false;
+  enif_cond_broadcast(stream->cond);
+  ret = ATOM_OK;
+
+exit:
+  enif_mutex_unlock(stream->lock);
+  return ret;
+}
+
+int nif_seekable_source_init(ErlNifEnv *env) {
+  ErlNifResourceTypeInit seekable_source_rt_init;
+
+  seekable_source_rt_init.dtor = seekable_source_rt_dtor;
+  seekable_source_rt_init.stop = NULL;
+  seekable_source_rt_init.down = seekable_source_rt_down;
+
+  SEEKABLE_SOURCE_RT = enif_open_resource_type_x(
+      env, "seekable source resource", &seekable_source_rt_init,
+      ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef VIX_SEEKABLE_SOURCE_H
+#define VIX_SEEKABLE_SOURCE_H
+
+#include "erl_nif.h"
+#include <glib.h>
+#include <stdbool.h>
+
+typedef struct _VixSeekableSource {
+  /* process serving the reads */
+  ErlNifPid server;
+  /* tag of the messages sent to the server */
+  ErlNifEnv *ref_env;
+  ERL_NIF_TERM ref;
+  /* guards every field below */
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+  gint64 position;
+  /* total size, -1 if unknown */
+  gint64 size;
+  bool closed;
+  /* a reader owns the fields below, others wait until it is done */
+  bool busy;
+  /* the read in flight, a single one at a time */
+  ErlNifUInt64 request_id;
+  bool pending;
+  void *read_buffer;
+  gint64 read_length;
+  gint64 read_result;
+  /* reason returned by the server for a failed read */
+  char read_error[128];
+} VixSeekableSource;
+
+ERL_NIF_TERM nif_seekable_source_new(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_seekable_source_reply(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]);
+
+int nif_seekable_source_init(ErlNifEnv *env);
+
+#endif
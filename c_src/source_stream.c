@@ -0,0 +1,314 @@
+#include <glib-object.h>
+#include <string.h>
+#include <vips/vips.h>
+
+#include "g_object/g_object.h"
+#include "source_stream.h"
+#include "utils.h"
+
+/* A source stream lets an Erlang process feed a loader. The producer
+ * enqueues iovecs into a native queue which holds references to refc
+ * binaries instead of copying them, and the "read" handler of the
+ * custom source copies bytes from the queue into the libvips buffer.
+ *
+ * The queue is bounded: once `max_queued` bytes are pending, writes
+ * return `:wait` and the producer must wait for `{ref, :ready}` which
+ * is sent when the reader has drained half of the queue.
+ *
+ * Reads block until data is available, the producer finishes the
+ * stream, or the stream is closed. A producer exiting without
+ * finishing the stream fails the read.
+ */
+
+static ErlNifResourceType *SOURCE_STREAM_RT;
+
+static const size_t SOURCE_STREAM_MAX_IOVEC_ELEMENTS = 64;
+
+static void source_stream_rt_dtor(ErlNifEnv *env, void *obj) {
+  VixSourceStream *stream = (VixSourceStream *)obj;
+
+  debug("VixSourceStream source_stream_rt_dtor called");
+
+  if (stream->queue)
+    enif_ioq_destroy(stream->queue);
+
+  if (stream->ref_env)
+    enif_free_env(stream->ref_env);
+
+  if (stream->cond)
+    enif_cond_destroy(stream->cond);
+
+  if (stream->lock)
+    enif_mutex_destroy(stream->lock);
+}
+
+/* must be called with the lock held */
+static void source_stream_notify_ready(VixSourceStream *stream) {
+  ErlNifEnv *msg_env;
+
+  if (!stream->waiting)
+    return;
+
+  stream->waiting = false;
+
+  msg_env = enif_alloc_env();
+  // called from threads which are not bound to a process
+  enif_send(NULL, &stream->producer, msg_env,
+            enif_make_tuple2(msg_env, enif_make_copy(msg_env, stream->ref),
+                             make_atom(msg_env, "ready")));
+  enif_free_env(msg_env);
+}
+
+static void source_stream_mark_closed(VixSourceStream *stream) {
+  enif_mutex_lock(stream->lock);
+  stream->closed = true;
+  enif_ioq_deq(stream->queue, enif_ioq_size(stream->queue), NULL);
+  enif_cond_broadcast(stream->cond);
+  // a waiting producer gets `{:error, :closed}` on the next write
+  source_stream_notify_ready(stream);
+  enif_mutex_unlock(stream->lock);
+}
+
+static void source_stream_rt_down(ErlNifEnv *env, void *obj, ErlNifPid *pid,
+                                  ErlNifMonitor *monitor) {
+  VixSourceStream *stream = (VixSourceStream *)obj;
+
+  enif_mutex_lock(stream->lock);
+
+  if (!stream->eof) {
+    debug("source stream producer is down before the end of the stream");
+    stream->closed = true;
+    enif_cond_broadcast(stream->cond);
+  }
+
+  enif_mutex_unlock(stream->lock);
+}
+
+static gint64 source_stream_on_read(VipsSourceCustom *source, void *buffer,
+                                    gint64 length, VixSourceStream *stream) {
+  unsigned char *bytes = buffer;
+  SysIOVec *iov;
+  int iovcnt, i;
+  size_t copied = 0, size;
+
+  enif_mutex_lock(stream->lock);
+
+  while (enif_ioq_size(stream->queue) == 0 && !stream->eof &&
+         !stream->closed)
+    enif_cond_wait(stream->cond, stream->lock);
+
+  if (stream->closed) {
+    enif_mutex_unlock(stream->lock);
+    vips_error("VixSourceStream", "%s", "stream is closed");
+    return -1;
+  }
+
+  iov = enif_ioq_peek(stream->queue, &iovcnt);
+
+  for (i = 0; i < iovcnt && copied < (size_t)length; i++) {
+    size = MIN(iov[i].iov_len, (size_t)length - copied);
+    memcpy(bytes + copied, iov[i].iov_base, size);
+    copied += size;
+  }
+
+  if (copied > 0)
+    enif_ioq_deq(stream->queue, copied, NULL);
+
+  if (enif_ioq_size(stream->queue) <= stream->max_queued / 2)
+    source_stream_notify_ready(stream);
+
+  enif_mutex_unlock(stream->lock);
+
+  // 0 signals the end of the stream
+  return copied;
+}
+
+static void source_stream_on_source_dispose(gpointer data,
+                                            GObject *where_the_object_was) {
+  VixSourceStream *stream = (VixSourceStream *)data;
+
+  // nobody reads anymore
+  source_stream_mark_closed(stream);
+  enif_release_resource(stream);
+}
+
+static bool get_source_stream(ErlNifEnv *env, ERL_NIF_TERM term,
+                              VixSourceStream **stream) {
+  return enif_get_resource(env, term, SOURCE_STREAM_RT, (void **)stream);
+}
+
+ERL_NIF_TERM nif_source_stream_new(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixSourceStream *stream;
+  VipsSourceCustom *source;
+  ERL_NIF_TERM ret, source_term;
+  ErlNifUInt64 max_queued;
+
+  if (!enif_get_uint64(env, argv[0], &max_queued) || max_queued < 1) {
+    return make_error(env, "max queued bytes must be a positive integer");
+  }
+
+  stream = enif_alloc_resource(SOURCE_STREAM_RT, sizeof(VixSourceStream));
+  memset(stream, 0, sizeof(VixSourceStream));
+
+  stream->max_queued = max_queued;
+  stream->lock = enif_mutex_create("vix_source_stream_lock");
+  stream->cond = enif_cond_create("vix_source_stream_cond");
+  stream->queue = enif_ioq_create(ERL_NIF_IOQ_NORMAL);
+  stream->ref_env = enif_alloc_env();
+  stream->ref = enif_make_ref(stream->ref_env);
+
+  if (!stream->lock || !stream->cond || !stream->queue) {
+    ret = make_error(env, "failed to create source stream");
+    goto exit;
+  }
+
+  if (!enif_self(env, &stream->producer) ||
+      enif_monitor_process(env, stream, &stream->producer, NULL) != 0) {
+    ret = make_error(env, "failed to monitor source stream producer");
+    goto exit;
+  }
+
+  source = vips_source_custom_new();
+
+  g_signal_connect(source, "read", G_CALLBACK(source_stream_on_read),
+                   stream);
+
+  // the source can outlive every term referring to the stream
+  enif_keep_resource(stream);
+  g_object_weak_ref(G_OBJECT(source), source_stream_on_source_dispose,
+                    stream);
+
+  source_term = g_object_to_erl_term(env, (GObject *)source);
+
+  ret = make_ok(env, enif_make_tuple3(env, enif_make_resource(env, stream),
+                                      enif_make_copy(env, stream->ref),
+                                      source_term));
+
+exit:
+  enif_release_resource(stream);
+  return ret;
+}
+
+/* The iovec is enqueued in slices, so it is checked as a whole first.
+ * Failing half way would leave part of it in the queue */
+static bool is_binary_list(ErlNifEnv *env, ERL_NIF_TERM list) {
+  ERL_NIF_TERM head;
+
+  while (enif_get_list_cell(env, list, &head, &list)) {
+    if (!enif_is_binary(env, head))
+      return false;
+  }
+
+  return enif_is_empty_list(env, list);
+}
+
+ERL_NIF_TERM nif_source_stream_write(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  VixSourceStream *stream;
+  ErlNifIOVec vec, *iovec;
+  ERL_NIF_TERM term, tail, ret;
+
+  if (!get_source_stream(env, argv[0], &stream)) {
+    return make_error(env, "failed to get source stream");
+  }
+
+  enif_mutex_lock(stream->lock);
+
+  if (stream->closed) {
+    ret = enif_make_tuple2(env, ATOM_ERROR, make_atom(env, "closed"));
+    goto exit;
+  }
+
+  if (stream->eof) {
+    ret = make_error(env, "stream is already finished");
+    goto exit;
+  }
+
+  term = argv[1];
+
+  if (!is_binary_list(env, term)) {
+    ret = make_error(env, "argument must be a list of binaries");
+    goto exit;
+  }
+
+  while (!enif_is_empty_list(env, term)) {
+    iovec = &vec;
+
+    // refc binaries are referenced by the queue, not copied
+    if (!enif_inspect_iovec(env, SOURCE_STREAM_MAX_IOVEC_ELEMENTS, term,
+                            &tail, &iovec) ||
+        !enif_ioq_enqv(stream->queue, iovec, 0)) {
+      // only on allocation failure, wake the reader for what is queued
+      enif_cond_signal(stream->cond);
+      ret = make_error(env, "failed to enqueue data");
+      goto exit;
+    }
+
+    term = tail;
+  }
+
+  enif_cond_signal(stream->cond);
+
+  if (enif_ioq_size(stream->queue) >= stream->max_queued) {
+    stream->waiting = true;
+    ret = make_atom(env, "wait");
+  } else {
+    ret = ATOM_OK;
+  }
+
+exit:
+  enif_mutex_unlock(stream->lock);
+  return ret;
+}
+
+ERL_NIF_TERM nif_source_stream_finish(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixSourceStream *stream;
+
+  if (!get_source_stream(env, argv[0], &stream)) {
+    return make_error(env, "failed to get source stream");
+  }
+
+  enif_mutex_lock(stream->lock);
+  stream->eof = true;
+  enif_cond_broadcast(stream->cond);
+  enif_mutex_unlock(stream->lock);
+
+  return ATOM_OK;
+}
+
+ERL_NIF_TERM nif_source_stream_close(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixSourceStream *stream;
+
+  if (!get_source_stream(env, argv[0], &stream)) {
+    return make_error(env, "failed to get source stream");
+  }
+
+  source_stream_mark_closed(stream);
+
+  return ATOM_OK;
+}
+
+int nif_source_stream_init(ErlNifEnv *env) {
+  ErlNifResourceTypeInit source_stream_rt_init;
+
+  source_stream_rt_init.dtor = source_stream_rt_dtor;
+  source_stream_rt_init.stop = NULL;
+  source_stream_rt_init.down = source_stream_rt_down;
+
+  SOURCE_STREAM_RT = enif_open_resource_type_x(
+      env, "source stream resource", &source_stream_rt_init,
+      ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+
+  return 0;
+}
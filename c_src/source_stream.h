@@ -0,0 +1,38 @@
+#ifndef VIX_SOURCE_STREAM_H
+#define VIX_SOURCE_STREAM_H
+
+#include "erl_nif.h"
+#include <stdbool.h>
+
+typedef struct _VixSourceStream {
+  ErlNifPid producer;
+  /* tag of the messages sent to the producer */
+  ErlNifEnv *ref_env;
+  ERL_NIF_TERM ref;
+  /* guards every field below */
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+  ErlNifIOQueue *queue;
+  /* producer is asked to wait once this many bytes are queued */
+  size_t max_queued;
+  /* producer is waiting for `{ref, :ready}` */
+  bool waiting;
+  bool eof;
+  bool closed;
+} VixSourceStream;
+
+ERL_NIF_TERM nif_source_stream_new(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_source_stream_write(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_source_stream_finish(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_source_stream_close(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]);
+
+int nif_source_stream_init(ErlNifEnv *env);
+
+#endif
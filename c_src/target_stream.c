@@ -0,0 +1,297 @@
+#include <glib-object.h>
+#include <string.h>
+#include <vips/vips.h>
+
+#include "g_object/g_object.h"
+#include "target_stream.h"
+#include "utils.h"
+
+/* A target stream delivers the output of a saver directly to an
+ * Erlang process. Encoded bytes written to the custom target are
+ * collected into a binary which is sent to the consumer as it fills up,
+ * so the only copy made is the one out of the libvips write buffer.
+ *
+ * Flow control is credit based: one chunk is sent per credit and the
+ * writing thread blocks once the credits are exhausted, until the
+ * consumer grants more or goes away.
+ *
+ * Messages are `{ref, seq, binary}` for data followed by
+ * `{ref, seq, :eof}`. Chunks may be written from libvips worker
+ * threads, so the consumer must order them by `seq`.
+ */
+
+static ErlNifResourceType *TARGET_STREAM_RT;
+
+static const size_t TARGET_STREAM_CHUNK_SIZE = 64 * 1024;
+
+static void target_stream_rt_dtor(ErlNifEnv *env, void *obj) {
+  VixTargetStream *stream = (VixTargetStream *)obj;
+
+  debug("VixTargetStream target_stream_rt_dtor called");
+
+  if (stream->buffer.data)
+    enif_release_binary(&stream->buffer);
+
+  if (stream->ref_env)
+    enif_free_env(stream->ref_env);
+
+  if (stream->cond)
+    enif_cond_destroy(stream->cond);
+
+  if (stream->lock)
+    enif_mutex_destroy(stream->lock);
+}
+
+static void target_stream_mark_closed(VixTargetStream *stream) {
+  enif_mutex_lock(stream->lock);
+  stream->closed = true;
+  enif_cond_broadcast(stream->cond);
+  enif_mutex_unlock(stream->lock);
+}
+
+static void target_stream_rt_down(ErlNifEnv *env, void *obj, ErlNifPid *pid,
+                                  ErlNifMonitor *monitor) {
+  debug("target stream consumer is down");
+  target_stream_mark_closed((VixTargetStream *)obj);
+}
+
+/* must be called with the lock held */
+static bool target_stream_send(VixTargetStream *stream, ErlNifEnv *msg_env,
+                               ERL_NIF_TERM payload) {
+  ERL_NIF_TERM msg;
+
+  msg = enif_make_tuple3(msg_env, enif_make_copy(msg_env, stream->ref),
+                         enif_make_uint64(msg_env, stream->seq), payload);
+  stream->seq++;
+
+  // called from threads which are not bound to a process
+  if (!enif_send(NULL, &stream->consumer, msg_env, msg)) {
+    stream->closed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static bool target_stream_flush(VixTargetStream *stream) {
+  ErlNifEnv *msg_env;
+  bool ok;
+
+  if (stream->used == 0)
+    return true;
+
+  if (stream->used < stream->buffer.size &&
+      !enif_realloc_binary(&stream->buffer, stream->used)) {
+    error("failed to shrink target stream buffer");
+    return false;
+  }
+
+  enif_mutex_lock(stream->lock);
+
+  while (stream->credits == 0 && !stream->closed)
+    enif_cond_wait(stream->cond, stream->lock);
+
+  ok = !stream->closed;
+
+  if (ok) {
+    msg_env = enif_alloc_env();
+    // ownership of the buffer moves to the message
+    ok = target_stream_send(stream, msg_env,
+                            enif_make_binary(msg_env, &stream->buffer));
+    enif_free_env(msg_env);
+
+    stream->buffer.data = NULL;
+    stream->used = 0;
+    stream->credits--;
+  }
+
+  enif_mutex_unlock(stream->lock);
+
+  return ok;
+}
+
+static gint64 target_stream_on_write(VipsTargetCustom *target,
+                                     const void *data, gint64 length,
+                                     VixTargetStream *stream) {
+  const unsigned char *bytes = data;
+  gint64 written = 0;
+  size_t size;
+
+  while (written < length) {
+    if (!stream->buffer.data &&
+        !enif_alloc_binary(TARGET_STREAM_CHUNK_SIZE, &stream->buffer)) {
+      error("failed to allocate target stream buffer");
+      return -1;
+    }
+
+    size = MIN(TARGET_STREAM_CHUNK_SIZE - stream->used,
+               (size_t)(length - written));
+    memcpy(stream->buffer.data + stream->used, bytes + written, size);
+    stream->used += size;
+    written += size;
+
+    if (stream->used == TARGET_STREAM_CHUNK_SIZE &&
+        !target_stream_flush(stream))
+      return -1;
+  }
+
+  return length;
+}
+
+static bool target_stream_end(VixTargetStream *stream) {
+  ErlNifEnv *msg_env;
+  bool ok;
+
+  if (!target_stream_flush(stream))
+    return false;
+
+  enif_mutex_lock(stream->lock);
+
+  ok = !stream->closed;
+
+  if (ok) {
+    msg_env = enif_alloc_env();
+    ok = target_stream_send(stream, msg_env, make_atom(msg_env, "eof"));
+    enif_free_env(msg_env);
+  }
+
+  enif_mutex_unlock(stream->lock);
+
+  return ok;
+}
+
+#if (VIPS_MAJOR_VERSION < 8) ||                                                \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION < 13)
+static void target_stream_on_finish(VipsTargetCustom *target,
+                                    VixTargetStream *stream) {
+  target_stream_end(stream);
+}
+#else
+static int target_stream_on_end(VipsTargetCustom *target,
+                                VixTargetStream *stream) {
+  return target_stream_end(stream) ? 0 : -1;
+}
+#endif
+
+static void target_stream_on_target_dispose(gpointer data,
+                                            GObject *where_the_object_was) {
+  enif_release_resource(data);
+}
+
+static bool get_target_stream(ErlNifEnv *env, ERL_NIF_TERM term,
+                              VixTargetStream **stream) {
+  return enif_get_resource(env, term, TARGET_STREAM_RT, (void **)stream);
+}
+
+ERL_NIF_TERM nif_target_stream_new(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixTargetStream *stream;
+  VipsTargetCustom *target;
+  ERL_NIF_TERM ret, target_term;
+  int credits;
+
+  if (!enif_get_int(env, argv[0], &credits) || credits < 1) {
+    return make_error(env, "credits must be a positive integer");
+  }
+
+  stream = enif_alloc_resource(TARGET_STREAM_RT, sizeof(VixTargetStream));
+  memset(stream, 0, sizeof(VixTargetStream));
+
+  stream->credits = credits;
+  stream->lock = enif_mutex_create("vix_target_stream_lock");
+  stream->cond = enif_cond_create("vix_target_stream_cond");
+  stream->ref_env = enif_alloc_env();
+  stream->ref = enif_make_ref(stream->ref_env);
+
+  if (!stream->lock || !stream->cond) {
+    ret = make_error(env, "failed to create target stream lock");
+    goto exit;
+  }
+
+  if (!enif_self(env, &stream->consumer) ||
+      enif_monitor_process(env, stream, &stream->consumer, NULL) != 0) {
+    ret = make_error(env, "failed to monitor target stream consumer");
+    goto exit;
+  }
+
+  target = vips_target_custom_new();
+
+  g_signal_connect(target, "write", G_CALLBACK(target_stream_on_write),
+                   stream);
+#if (VIPS_MAJOR_VERSION < 8) ||                                                \
+    (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION < 13)
+  g_signal_connect(target, "finish", G_CALLBACK(target_stream_on_finish),
+                   stream);
+#else
+  g_signal_connect(target, "end", G_CALLBACK(target_stream_on_end), stream);
+#endif
+
+  // the target can outlive every term referring to the stream
+  enif_keep_resource(stream);
+  g_object_weak_ref(G_OBJECT(target), target_stream_on_target_dispose,
+                    stream);
+
+  target_term = g_object_to_erl_term(env, (GObject *)target);
+
+  ret = make_ok(env, enif_make_tuple3(env, enif_make_resource(env, stream),
+                                      enif_make_copy(env, stream->ref),
+                                      target_term));
+
+exit:
+  enif_release_resource(stream);
+  return ret;
+}
+
+ERL_NIF_TERM nif_target_stream_credit(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  VixTargetStream *stream;
+  int credits;
+
+  if (!get_target_stream(env, argv[0], &stream)) {
+    return make_error(env, "failed to get target stream");
+  }
+
+  if (!enif_get_int(env, argv[1], &credits) || credits < 1) {
+    return make_error(env, "credits must be a positive integer");
+  }
+
+  enif_mutex_lock(stream->lock);
+  stream->credits += credits;
+  enif_cond_signal(stream->cond);
+  enif_mutex_unlock(stream->lock);
+
+  return ATOM_OK;
+}
+
+ERL_NIF_TERM nif_target_stream_close(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VixTargetStream *stream;
+
+  if (!get_target_stream(env, argv[0], &stream)) {
+    return make_error(env, "failed to get target stream");
+  }
+
+  target_stream_mark_closed(stream);
+
+  return ATOM_OK;
+}
+
+int nif_target_stream_init(ErlNifEnv *env) {
+  ErlNifResourceTypeInit target_stream_rt_init;
+
+  target_stream_rt_init.dtor = target_stream_rt_dtor;
+  target_stream_rt_init.stop = NULL;
+  target_stream_rt_init.down = target_stream_rt_down;
+
+  TARGET_STREAM_RT = enif_open_resource_type_x(
+      env, "target stream resource", &target_stream_rt_init,
+      ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef VIX_TARGET_STREAM_H
+#define VIX_TARGET_STREAM_H
+
+#include "erl_nif.h"
+#include <stdbool.h>
+
+typedef struct _VixTargetStream {
+  ErlNifPid consumer;
+  /* tag of all messages sent to the consumer */
+  ErlNifEnv *ref_env;
+  ERL_NIF_TERM ref;
+  /* guards credits, closed and seq. Chunks are sent while holding the
+   * lock so that no message is sent once the stream is closed */
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+  int credits;
+  bool closed;
+  ErlNifUInt64 seq;
+  /* pending bytes, only touched by the thread writing to the target */
+  ErlNifBinary buffer;
+  size_t used;
+} VixTargetStream;
+
+ERL_NIF_TERM nif_target_stream_new(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_target_stream_credit(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_target_stream_close(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]);
+
+int nif_target_stream_init(ErlNifEnv *env);
+
+#endif
@@ -1,3 +1,4 @@
+#include "janitor.h"
 #include "utils.h"
 #include <errno.h>
 #include <glib-object.h>
@@ -19,12 +20,6 @@ ERL_NIF_TERM ATOM_NULL_VALUE;
 ERL_NIF_TERM ATOM_UNDEFINED;
 ERL_NIF_TERM ATOM_EAGAIN;
 
-/**
- * Name of the process responsible for cleanup, we send resources
- * requiring cleanup to this process.
- */
-static ERL_NIF_TERM VIX_JANITOR_PROCESS_NAME;
-
 const guint VIX_LOG_LEVEL_NONE = 0;
 const guint VIX_LOG_LEVEL_WARNING = 1;
 const guint VIX_LOG_LEVEL_ERROR = 2;
@@ -108,29 +103,14 @@ VixResult vix_result(ERL_NIF_TERM term) {
   return (VixResult){.is_success = true, .result = term};
 }
 
-void send_to_janitor(ErlNifEnv *env, ERL_NIF_TERM label,
-                     ERL_NIF_TERM resource_term) {
-  ErlNifPid pid;
-
-  /* Currently there is no way to raise error when any of the
-     condition fail. Realistically this should never fail */
-  if (!enif_whereis_pid(env, VIX_JANITOR_PROCESS_NAME, &pid)) {
-    error("Failed to get pid for vix janitor process");
-    return;
-  }
-
-  if (!enif_send(env, &pid, NULL,
-                 enif_make_tuple2(env, label, resource_term))) {
-    error("Failed to send unref msg to vix janitor");
-    return;
-  }
-
-  return;
-}
-
 static void vix_binary_dtor(ErlNifEnv *env, void *ptr) {
   VixBinaryResource *vix_bin_r = (VixBinaryResource *)ptr;
-  g_free(vix_bin_r->data);
+
+  if (vix_bin_r->owner)
+    janitor_unref_g_object(vix_bin_r->owner);
+  else
+    g_free(vix_bin_r->data);
+
   debug("vix_binary_resource dtor");
 }
 
@@ -144,8 +124,6 @@ int utils_init(ErlNifEnv *env, const char *log_level) {
   ATOM_UNDEFINED = make_atom(env, "undefined");
   ATOM_EAGAIN = make_atom(env, "eagain");
 
-  VIX_JANITOR_PROCESS_NAME = make_atom(env, "Elixir.Vix.Nif.Janitor");
-
   VIX_BINARY_RT = enif_open_resource_type(
       env, NULL, "vix_binary_resource", (ErlNifResourceDtor *)vix_binary_dtor,
       ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
@@ -214,6 +192,28 @@ ERL_NIF_TERM to_binary_term(ErlNifEnv *env, void *data, size_t size) {
 
   vix_bin_r->data = data;
   vix_bin_r->size = size;
+  vix_bin_r->owner = NULL;
+
+  bin_term = enif_make_resource_binary(env, vix_bin_r, vix_bin_r->data,
+                                       vix_bin_r->size);
+
+  enif_release_resource(vix_bin_r);
+
+  return bin_term;
+}
+
+/* Makes a binary of `data` without copying it. `data` must be owned by
+ * `owner` and must not change for the lifetime of `owner`. The binary
+ * holds a reference to `owner` */
+ERL_NIF_TERM to_shared_binary_term(ErlNifEnv *env, GObject *owner, void *data,
+                                   size_t size) {
+  VixBinaryResource *vix_bin_r =
+      enif_alloc_resource(VIX_BINARY_RT, sizeof(VixBinaryResource));
+  ERL_NIF_TERM bin_term;
+
+  vix_bin_r->data = data;
+  vix_bin_r->size = size;
+  vix_bin_r->owner = g_object_ref(owner);
 
   bin_term = enif_make_resource_binary(env, vix_bin_r, vix_bin_r->data,
                                        vix_bin_r->size);
@@ -77,10 +77,13 @@ typedef struct _VixResult {
   ERL_NIF_TERM result;
 } VixResult;
 
-/* size of the data is not really needed. but can be useful for debugging */
+/* size of the data is not really needed. but can be useful for debugging.
+ * `owner` is set when the data belongs to a GObject instead of the
+ * resource, see `to_shared_binary_term` */
 typedef struct _VixBinaryResource {
   void *data;
   size_t size;
+  GObject *owner;
 } VixBinaryResource;
 
 extern ErlNifResourceType *VIX_BINARY_RT;
@@ -132,7 +135,7 @@ void notify_consumed_timeslice(ErlNifEnv *env, ErlNifTime start,
 
 ERL_NIF_TERM to_binary_term(ErlNifEnv *env, void *data, size_t size);
 
-void send_to_janitor(ErlNifEnv *env, ERL_NIF_TERM label,
-                     ERL_NIF_TERM resource_term);
+ERL_NIF_TERM to_shared_binary_term(ErlNifEnv *env, GObject *owner, void *data,
+                                   size_t size);
 
 #endif
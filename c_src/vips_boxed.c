@@ -5,56 +5,96 @@
 #include <stdbool.h>
 #include <vips/vips.h>
 
+// Values are written straight into the vips area, without an
+// intermediate array
 static VipsArrayInt *erl_list_to_vips_int_array(ErlNifEnv *env,
                                                 ERL_NIF_TERM list,
-                                                unsigned int length,
-                                                int *array) {
+                                                unsigned int length) {
   ERL_NIF_TERM head, tail;
-  int value;
+  VipsArea *area;
+  int *array;
+
+  area = vips_area_new_array(G_TYPE_INT, sizeof(int), (int)length);
+  array = (int *)area->data;
 
   tail = list;
 
   for (unsigned int i = 0; i < length; i++) {
     if (!enif_get_list_cell(env, tail, &head, &tail)) {
       error("Failed to get list entry");
+      vips_area_unref(area);
       return NULL;
     }
 
-    if (!enif_get_int(env, head, &value)) {
+    if (!enif_get_int(env, head, &array[i])) {
       error("Failed to get int");
+      vips_area_unref(area);
       return NULL;
     }
-
-    array[i] = value;
   }
 
-  return vips_array_int_new(array, length);
+  return (VipsArrayInt *)area;
 }
 
 static VipsArrayDouble *erl_list_to_vips_double_array(ErlNifEnv *env,
                                                       ERL_NIF_TERM list,
-                                                      unsigned int length,
-                                                      double *array) {
+                                                      unsigned int length) {
   ERL_NIF_TERM head, tail;
-  double value;
+  VipsArea *area;
+  double *array;
+
+  area = vips_area_new_array(G_TYPE_DOUBLE, sizeof(double), (int)length);
+  array = (double *)area->data;
 
   tail = list;
 
   for (unsigned int i = 0; i < length; i++) {
     if (!enif_get_list_cell(env, tail, &head, &tail)) {
       error("Failed to get list entry");
+      vips_area_unref(area);
       return NULL;
     }
 
-    if (!enif_get_double(env, head, &value)) {
+    if (!enif_get_double(env, head, &array[i])) {
       error("Failed to get double");
+      vips_area_unref(area);
       return NULL;
     }
+  }
+
+  return (VipsArrayDouble *)area;
+}
 
-    array[i] = value;
+// Copies a packed native-endian binary into a new vips array. The
+// binary might be a sub-binary at any offset, so it is copied with
+// memcpy rather than read as an array of `type`
+static VipsArea *erl_binary_to_vips_array(ErlNifEnv *env, ERL_NIF_TERM term,
+                                          GType type, size_t size_of_type) {
+  ErlNifBinary bin;
+  VipsArea *area;
+  size_t length;
+
+  if (!enif_inspect_binary(env, term, &bin)) {
+    error("failed to get binary from erl term");
+    return NULL;
   }
 
-  return vips_array_double_new(array, length);
+  if (bin.size % size_of_type != 0) {
+    error("binary size is not a multiple of the element size");
+    return NULL;
+  }
+
+  length = bin.size / size_of_type;
+  if (length > G_MAXINT) {
+    error("binary is too large");
+    return NULL;
+  }
+
+  area = vips_area_new_array(type, size_of_type, (int)length);
+  if (length > 0)
+    memcpy(area->data, bin.data, bin.size);
+
+  return area;
 }
 
 static VipsArrayImage *erl_list_to_vips_image_array(ErlNifEnv *env,
@@ -88,9 +128,7 @@ ERL_NIF_TERM nif_int_array(ErlNifEnv *env, int argc,
 
   ASSERT_ARGC(argc, 1);
 
-  GBoxedResource *boxed_r;
   unsigned int len;
-  int *array;
   VipsArrayInt *vips_array;
   ERL_NIF_TERM ret;
   ErlNifTime start;
@@ -103,18 +141,14 @@ ERL_NIF_TERM nif_int_array(ErlNifEnv *env, int argc,
     goto exit;
   }
 
-  array = g_new(int, len);
+  vips_array = erl_list_to_vips_int_array(env, argv[0], len);
 
-  boxed_r = enif_alloc_resource(G_BOXED_RT, sizeof(GBoxedResource));
-  vips_array = erl_list_to_vips_int_array(env, argv[0], len, array);
-
-  boxed_r->boxed_type = VIPS_TYPE_ARRAY_INT;
-  boxed_r->boxed_ptr = vips_array;
-
-  ret = enif_make_resource(env, boxed_r);
-  enif_release_resource(boxed_r);
+  if (!vips_array) {
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
 
-  g_free(array);
+  ret = boxed_to_erl_term(env, vips_array, VIPS_TYPE_ARRAY_INT);
 
 exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
@@ -125,9 +159,7 @@ ERL_NIF_TERM nif_double_array(ErlNifEnv *env, int argc,
                               const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
 
-  GBoxedResource *boxed_r;
   unsigned int len;
-  double *array;
   VipsArrayDouble *vips_array;
   ERL_NIF_TERM ret;
   ErlNifTime start;
@@ -140,24 +172,49 @@ ERL_NIF_TERM nif_double_array(ErlNifEnv *env, int argc,
     goto exit;
   }
 
-  array = g_new(double, len);
-
-  boxed_r = enif_alloc_resource(G_BOXED_RT, sizeof(GBoxedResource));
-  vips_array = erl_list_to_vips_double_array(env, argv[0], len, array);
+  vips_array = erl_list_to_vips_double_array(env, argv[0], len);
 
-  boxed_r->boxed_type = VIPS_TYPE_ARRAY_DOUBLE;
-  boxed_r->boxed_ptr = vips_array;
-
-  ret = enif_make_resource(env, boxed_r);
-  enif_release_resource(boxed_r);
+  if (!vips_array) {
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
 
-  g_free(array);
+  ret = boxed_to_erl_term(env, vips_array, VIPS_TYPE_ARRAY_DOUBLE);
 
 exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   return ret;
 }
 
+ERL_NIF_TERM nif_int_array_from_binary(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VipsArea *area;
+
+  area = erl_binary_to_vips_array(env, argv[0], G_TYPE_INT, sizeof(int));
+
+  if (!area)
+    return enif_make_badarg(env);
+
+  return boxed_to_erl_term(env, area, VIPS_TYPE_ARRAY_INT);
+}
+
+ERL_NIF_TERM nif_double_array_from_binary(ErlNifEnv *env, int argc,
+                                          const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VipsArea *area;
+
+  area =
+      erl_binary_to_vips_array(env, argv[0], G_TYPE_DOUBLE, sizeof(double));
+
+  if (!area)
+    return enif_make_badarg(env);
+
+  return boxed_to_erl_term(env, area, VIPS_TYPE_ARRAY_DOUBLE);
+}
+
 ERL_NIF_TERM nif_image_array(ErlNifEnv *env, int argc,
                              const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
@@ -366,6 +423,49 @@ exit:
     return enif_make_tuple2(env, ATOM_ERROR, res.result);
 }
 
+static ERL_NIF_TERM vips_array_to_erl_binary(ErlNifEnv *env,
+                                             ERL_NIF_TERM term, GType type,
+                                             const char *type_name) {
+  VipsArea *area;
+  ERL_NIF_TERM bin_term;
+  GType boxed_type;
+  size_t size;
+  unsigned char *erl_bin_data;
+
+  if (!erl_term_boxed_type(env, term, &boxed_type)) {
+    return make_error(env, "failed to get type of boxed term");
+  }
+
+  if (boxed_type != type) {
+    return make_error(env, type_name);
+  }
+
+  if (!erl_term_to_g_boxed(env, term, (gpointer *)&area)) {
+    return make_error(env, "failed to get boxed term");
+  }
+
+  size = area->n * area->sizeof_type;
+  erl_bin_data = enif_make_new_binary(env, size, &bin_term);
+  if (size > 0)
+    memcpy(erl_bin_data, area->data, size);
+
+  return make_ok(env, bin_term);
+}
+
+ERL_NIF_TERM nif_vips_int_array_to_binary(ErlNifEnv *env, int argc,
+                                          const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+  return vips_array_to_erl_binary(env, argv[0], VIPS_TYPE_ARRAY_INT,
+                                  "term is not a VIPS_TYPE_ARRAY_INT");
+}
+
+ERL_NIF_TERM nif_vips_double_array_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+  return vips_array_to_erl_binary(env, argv[0], VIPS_TYPE_ARRAY_DOUBLE,
+                                  "term is not a VIPS_TYPE_ARRAY_DOUBLE");
+}
+
 ERL_NIF_TERM nif_vips_image_array_to_erl_list(ErlNifEnv *env, int argc,
                                               const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
@@ -8,6 +8,12 @@ ERL_NIF_TERM nif_int_array(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]);
 ERL_NIF_TERM nif_double_array(ErlNifEnv *env, int argc,
                               const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_int_array_from_binary(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_double_array_from_binary(ErlNifEnv *env, int argc,
+                                          const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_image_array(ErlNifEnv *env, int argc,
                              const ERL_NIF_TERM argv[]);
 
@@ -22,6 +28,12 @@ ERL_NIF_TERM nif_vips_int_array_to_erl_list(ErlNifEnv *env, int argc,
 ERL_NIF_TERM nif_vips_double_array_to_erl_list(ErlNifEnv *env, int argc,
                                                const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_vips_int_array_to_binary(ErlNifEnv *env, int argc,
+                                          const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_vips_double_array_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_vips_image_array_to_erl_list(ErlNifEnv *env, int argc,
                                               const ERL_NIF_TERM argv[]);
 
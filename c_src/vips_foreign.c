@@ -3,6 +3,7 @@
 
 #include "g_object/g_object.h"
 #include "g_object/g_value.h"
+#include "load_index.h"
 #include "utils.h"
 #include "vips_foreign.h"
 
@@ -23,7 +24,10 @@ ERL_NIF_TERM nif_foreign_find_load_buffer(ErlNifEnv *env, int argc,
     goto exit;
   }
 
-  name = vips_foreign_find_load_buffer(bin.data, bin.size);
+  name = load_index_find_buffer(bin.data, bin.size);
+
+  if (!name)
+    name = vips_foreign_find_load_buffer(bin.data, bin.size);
 
   if (!name) {
     error("Failed to find load buffer. error: %s", vips_error_buffer());
@@ -151,7 +155,10 @@ ERL_NIF_TERM nif_foreign_find_load_source(ErlNifEnv *env, int argc,
     goto exit;
   }
 
-  name = vips_foreign_find_load_source(source);
+  name = load_index_find_source(source);
+
+  if (!name)
+    name = vips_foreign_find_load_source(source);
 
   if (!name) {
     error("Failed to find the loader for the source. error: %s",
@@ -201,46 +208,6 @@ exit:
   return ret;
 }
 
-ERL_NIF_TERM nif_foreign_get_suffixes(ErlNifEnv *env, int argc,
-                                      const ERL_NIF_TERM argv[]) {
-  ASSERT_ARGC(argc, 0);
-
-  ErlNifTime start;
-  ERL_NIF_TERM ret;
-  gchar **suffixes;
-  ERL_NIF_TERM list;
-  ERL_NIF_TERM bin;
-  ssize_t length;
-  unsigned char *temp;
-
-  start = enif_monotonic_time(ERL_NIF_USEC);
-
-  suffixes = vips_foreign_get_suffixes();
-
-  if (!suffixes) {
-    error("Failed to fetch suffixes. error: %s", vips_error_buffer());
-    vips_error_clear();
-    ret = make_error(env, "Failed to fetch suffixes");
-    goto exit;
-  }
-
-  list = enif_make_list(env, 0);
-  for (int i = 0; suffixes[i] != NULL; i++) {
-    length = strlen(suffixes[i]);
-    temp = enif_make_new_binary(env, length, &bin);
-    memcpy(temp, suffixes[i], length);
-
-    list = enif_make_list_cell(env, bin, list);
-  }
-  g_strfreev(suffixes);
-
-  ret = make_ok(env, list);
-
-exit:
-  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
-  return ret;
-}
-
 /**
  *
  * Based on
@@ -309,42 +276,117 @@ static gchar **vips_foreign_get_loader_suffixes(void) {
   return (suffs);
 }
 
+/* Loaders and savers are registered when libvips starts, so the suffix
+ * tables are built once at load time in a private env and copied to
+ * the caller's env on each call */
+static ErlNifEnv *foreign_env = NULL;
+static ERL_NIF_TERM saver_suffixes;
+static ERL_NIF_TERM loader_suffixes;
+static ERL_NIF_TERM savers;
+
+/* list of the suffixes without duplicates, suffixes are taken as is,
+ * libvips lists them in lower case */
+static ERL_NIF_TERM make_suffix_list(ErlNifEnv *env, gchar **suffixes) {
+  GHashTable *seen;
+  ERL_NIF_TERM list;
+
+  seen = g_hash_table_new(g_str_hash, g_str_equal);
+  list = enif_make_list(env, 0);
+
+  for (int i = 0; suffixes[i] != NULL; i++) {
+    if (!g_hash_table_add(seen, suffixes[i]))
+      continue;
+
+    list = enif_make_list_cell(env, make_binary(env, suffixes[i]), list);
+  }
+
+  g_hash_table_destroy(seen);
+
+  return list;
+}
+
+typedef const char *(*FindSaveFn)(const char *);
+
+/* map of each suffix to the name of the saver libvips picks for it.
+ * Suffixes without a saver are left out */
+static ERL_NIF_TERM make_saver_map(ErlNifEnv *env, gchar **suffixes,
+                                   FindSaveFn find_save) {
+  ERL_NIF_TERM map, key;
+  const char *name;
+
+  map = enif_make_new_map(env);
+
+  for (int i = 0; suffixes[i] != NULL; i++) {
+    name = find_save(suffixes[i]);
+
+    if (!name) {
+      vips_error_clear();
+      continue;
+    }
+
+    key = make_binary(env, suffixes[i]);
+    enif_make_map_put(env, map, key, make_binary(env, name), &map);
+  }
+
+  return map;
+}
+
+static ERL_NIF_TERM make_savers(ErlNifEnv *env, gchar **suffixes) {
+  ERL_NIF_TERM keys[3], values[3], map;
+
+  keys[0] = make_atom(env, "file");
+  values[0] = make_saver_map(env, suffixes, vips_foreign_find_save);
+
+  keys[1] = make_atom(env, "buffer");
+  values[1] = make_saver_map(env, suffixes, vips_foreign_find_save_buffer);
+
+  keys[2] = make_atom(env, "target");
+  values[2] = make_saver_map(env, suffixes, vips_foreign_find_save_target);
+
+  enif_make_map_from_arrays(env, keys, values, 3, &map);
+
+  return map;
+}
+
+ERL_NIF_TERM nif_foreign_get_suffixes(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 0);
+  return make_ok(env, enif_make_copy(env, saver_suffixes));
+}
+
 ERL_NIF_TERM nif_foreign_get_loader_suffixes(ErlNifEnv *env, int argc,
                                              const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 0);
+  return make_ok(env, enif_make_copy(env, loader_suffixes));
+}
 
-  ErlNifTime start;
-  ERL_NIF_TERM ret;
-  gchar **loader_suffixes;
-  ERL_NIF_TERM list;
-  ERL_NIF_TERM bin;
-  ssize_t length;
-  unsigned char *temp;
+ERL_NIF_TERM nif_foreign_get_savers(ErlNifEnv *env, int argc,
+                                    const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 0);
+  return make_ok(env, enif_make_copy(env, savers));
+}
 
-  start = enif_monotonic_time(ERL_NIF_USEC);
+int nif_foreign_init(ErlNifEnv *env) {
+  gchar **suffixes;
+  gchar **loader_suffixes_array;
 
-  loader_suffixes = vips_foreign_get_loader_suffixes();
+  suffixes = vips_foreign_get_suffixes();
 
-  if (!loader_suffixes) {
-    error("Failed to fetch loader suffixes. error: %s", vips_error_buffer());
+  if (!suffixes) {
+    error("Failed to fetch suffixes. error: %s", vips_error_buffer());
     vips_error_clear();
-    ret = make_error(env, "Failed to fetch loader_suffixes");
-    goto exit;
+    return 1;
   }
 
-  list = enif_make_list(env, 0);
-  for (int i = 0; loader_suffixes[i] != NULL; i++) {
-    length = strlen(loader_suffixes[i]);
-    temp = enif_make_new_binary(env, length, &bin);
-    memcpy(temp, loader_suffixes[i], length);
+  loader_suffixes_array = vips_foreign_get_loader_suffixes();
 
-    list = enif_make_list_cell(env, bin, list);
-  }
-  g_strfreev(loader_suffixes);
+  foreign_env = enif_alloc_env();
+  saver_suffixes = make_suffix_list(foreign_env, suffixes);
+  loader_suffixes = make_suffix_list(foreign_env, loader_suffixes_array);
+  savers = make_savers(foreign_env, suffixes);
 
-  ret = make_ok(env, list);
+  g_strfreev(suffixes);
+  g_strfreev(loader_suffixes_array);
 
-exit:
-  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
-  return ret;
+  return 0;
 }
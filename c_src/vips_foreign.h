@@ -27,4 +27,9 @@ ERL_NIF_TERM nif_foreign_get_suffixes(ErlNifEnv *env, int argc,
 ERL_NIF_TERM nif_foreign_get_loader_suffixes(ErlNifEnv *env, int argc,
                                              const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_foreign_get_savers(ErlNifEnv *env, int argc,
+                                    const ERL_NIF_TERM argv[]);
+
+int nif_foreign_init(ErlNifEnv *env);
+
 #endif
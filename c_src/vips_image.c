@@ -3,6 +3,7 @@
 
 #include "g_object/g_object.h"
 #include "g_object/g_value.h"
+#include "parallel.h"
 #include "utils.h"
 #include "vips_image.h"
 
@@ -148,6 +149,42 @@ exit:
   return ret;
 }
 
+/* Unlike `vips_image_copy_memory`, which returns images already in
+ * memory as is, always writes the pixels to a new buffer. Images drawn
+ * on in place must own their pixels */
+ERL_NIF_TERM nif_image_copy_memory_private(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 1);
+
+  VipsImage *image;
+  VipsImage *copy;
+  ErlNifTime start;
+  ERL_NIF_TERM ret;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!erl_term_to_g_object(env, argv[0], (GObject **)&image)) {
+    ret = make_error(env, "Failed to get VipsImage");
+    goto exit;
+  }
+
+  copy = vips_image_new_memory();
+
+  if (vips_image_write(image, copy)) {
+    error("Failed to memory copy image. error: %s", vips_error_buffer());
+    vips_error_clear();
+    g_object_unref(copy);
+    ret = make_error(env, "Failed to memory copy image");
+    goto exit;
+  }
+
+  ret = make_ok(env, g_object_to_erl_term(env, (GObject *)copy));
+
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return ret;
+}
+
 ERL_NIF_TERM nif_image_write_to_file(ErlNifEnv *env, int argc,
                                      const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 2);
@@ -368,6 +405,76 @@ exit:
   return ret;
 }
 
+ERL_NIF_TERM nif_image_new_matrix_from_binary(ErlNifEnv *env, int argc,
+                                              const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 5);
+
+  VipsImage *image;
+  int width, height;
+  double scale, offset;
+  ErlNifBinary bin;
+  ERL_NIF_TERM ret;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!enif_get_int(env, argv[0], &width) || width <= 0) {
+    error("failed to get width");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  if (!enif_get_int(env, argv[1], &height) || height <= 0) {
+    error("failed to get height");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  if (!enif_inspect_binary(env, argv[2], &bin)) {
+    error("failed to get binary");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  if (!enif_get_double(env, argv[3], &scale)) {
+    error("Failed to get scale");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  if (!enif_get_double(env, argv[4], &offset)) {
+    error("Failed to get offset");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  if (bin.size != (size_t)width * (size_t)height * sizeof(double)) {
+    ret = make_error(env, "binary size does not match width * height * 8");
+    goto exit;
+  }
+
+  image = vips_image_new_matrix(width, height);
+
+  if (!image) {
+    error("Failed to create matrix. error: %s", vips_error_buffer());
+    vips_error_clear();
+    ret = make_error(env, "Failed create matrix from binary");
+    goto exit;
+  }
+
+  // matrix images are a single memory buffer of doubles, row by row
+  memcpy(VIPS_IMAGE_ADDR(image, 0, 0), bin.data, bin.size);
+
+  vips_image_set_double(image, "scale", scale);
+  vips_image_set_double(image, "offset", offset);
+
+  ret = make_ok(env, g_object_to_erl_term(env, (GObject *)image));
+
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return ret;
+}
+
 ERL_NIF_TERM nif_image_get_fields(ErlNifEnv *env, int argc,
                                   const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
@@ -407,22 +514,175 @@ exit:
   return ret;
 }
 
+static ERL_NIF_TERM enum_value_atom(ErlNifEnv *env, GType type, int value) {
+  GEnumClass *enum_class;
+  GEnumValue *enum_value;
+  ERL_NIF_TERM atom;
+
+  enum_class = g_type_class_ref(type);
+  enum_value = g_enum_get_value(enum_class, value);
+  atom = enum_value ? make_atom(env, enum_value->value_name) : ATOM_NIL;
+  g_type_class_unref(enum_class);
+
+  return atom;
+}
+
+static VixImageHeader *get_image_header(ErlNifEnv *env,
+                                        GObjectResource *gobject_r,
+                                        VipsImage *image) {
+  VixImageHeader *header = &gobject_r->image_header;
+
+  // concurrent readers might fill it twice, with the same values
+  if (!g_atomic_int_get(&header->ready)) {
+    header->width = vips_image_get_width(image);
+    header->height = vips_image_get_height(image);
+    header->bands = vips_image_get_bands(image);
+    header->format = enum_value_atom(env, VIPS_TYPE_BAND_FORMAT,
+                                     vips_image_get_format(image));
+    header->interpretation =
+        enum_value_atom(env, VIPS_TYPE_INTERPRETATION,
+                        vips_image_get_interpretation(image));
+    g_atomic_int_set(&header->ready, 1);
+  }
+
+  return header;
+}
+
+typedef enum {
+  CORE_HEADER_NONE,
+  CORE_HEADER_WIDTH,
+  CORE_HEADER_HEIGHT,
+  CORE_HEADER_BANDS,
+  CORE_HEADER_FORMAT,
+  CORE_HEADER_INTERPRETATION,
+} CoreHeaderField;
+
+static CoreHeaderField core_header_field(const char *name) {
+  if (strcmp(name, "width") == 0)
+    return CORE_HEADER_WIDTH;
+  else if (strcmp(name, "height") == 0)
+    return CORE_HEADER_HEIGHT;
+  else if (strcmp(name, "bands") == 0)
+    return CORE_HEADER_BANDS;
+  else if (strcmp(name, "format") == 0)
+    return CORE_HEADER_FORMAT;
+  else if (strcmp(name, "interpretation") == 0)
+    return CORE_HEADER_INTERPRETATION;
+  else
+    return CORE_HEADER_NONE;
+}
+
+/* Other fields are read through GValue, they neither fill the cache
+ * nor build any term here */
+static bool get_cached_header(ErlNifEnv *env, GObjectResource *gobject_r,
+                              VipsImage *image, const char *name,
+                              ERL_NIF_TERM *term) {
+  CoreHeaderField field = core_header_field(name);
+  VixImageHeader *header;
+  GType type;
+  ERL_NIF_TERM value;
+
+  if (field == CORE_HEADER_NONE)
+    return false;
+
+  header = get_image_header(env, gobject_r, image);
+
+  switch (field) {
+  case CORE_HEADER_WIDTH:
+    type = G_TYPE_INT;
+    value = enif_make_int(env, header->width);
+    break;
+  case CORE_HEADER_HEIGHT:
+    type = G_TYPE_INT;
+    value = enif_make_int(env, header->height);
+    break;
+  case CORE_HEADER_BANDS:
+    type = G_TYPE_INT;
+    value = enif_make_int(env, header->bands);
+    break;
+  case CORE_HEADER_FORMAT:
+    type = VIPS_TYPE_BAND_FORMAT;
+    value = header->format;
+    break;
+  default:
+    type = VIPS_TYPE_INTERPRETATION;
+    value = header->interpretation;
+  }
+
+  *term = enif_make_tuple2(env, make_binary(env, g_type_name(type)), value);
+
+  return true;
+}
+
+/* Returns `{type_name, value}` of the header field `name` */
+static VixResult get_header_term(ErlNifEnv *env, GObjectResource *gobject_r,
+                                 VipsImage *image, const char *name) {
+  GType type;
+  GValue gvalue = {0};
+  ERL_NIF_TERM term;
+  VixResult res;
+
+  if (get_cached_header(env, gobject_r, image, name, &term))
+    return vix_result(term);
+
+  type = vips_image_get_typeof(image, name);
+
+  if (type == 0) {
+    res.is_success = false;
+    res.result = make_binary(env, "No such field");
+    return res;
+  }
+
+  if (vips_image_get(image, name, &gvalue)) {
+    g_value_unset(&gvalue);
+    error("Failed to get GValue. error: %s", vips_error_buffer());
+    vips_error_clear();
+    res.is_success = false;
+    res.result = make_binary(env, "Failed to get GValue");
+    return res;
+  }
+
+  res = g_value_to_erl_term(env, gvalue);
+
+  if (res.is_success) {
+    term = make_binary(env, g_type_name(type));
+    res.result = enif_make_tuple2(env, term, res.result);
+  }
+
+  return res;
+}
+
+static bool get_image_resource(ErlNifEnv *env, ERL_NIF_TERM term,
+                               GObjectResource **gobject_r,
+                               VipsImage **image) {
+  GObject *obj;
+
+  if (!erl_term_to_g_object_resource(env, term, gobject_r))
+    return false;
+
+  obj = g_object_resource_get(*gobject_r);
+
+  if (!obj || !VIPS_IS_IMAGE(obj))
+    return false;
+
+  *image = VIPS_IMAGE(obj);
+  return true;
+}
+
 ERL_NIF_TERM nif_image_get_header(ErlNifEnv *env, int argc,
                                   const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 2);
 
+  GObjectResource *gobject_r;
   VipsImage *image;
   char header_name[MAX_HEADER_NAME_LENGTH];
-  GType type;
   ERL_NIF_TERM ret;
-  ERL_NIF_TERM type_name;
   ErlNifTime start;
-  GValue gvalue = {0};
   VixResult res;
 
   start = enif_monotonic_time(ERL_NIF_USEC);
 
-  if (!erl_term_to_g_object(env, argv[0], (GObject **)&image)) {
+  if (!get_image_resource(env, argv[0], &gobject_r, &image)) {
     ret = make_error(env, "Failed to get VipsImage");
     goto exit;
   }
@@ -432,30 +692,71 @@ ERL_NIF_TERM nif_image_get_header(ErlNifEnv *env, int argc,
     goto exit;
   }
 
-  type = vips_image_get_typeof(image, header_name);
+  res = get_header_term(env, gobject_r, image, header_name);
 
-  if (type == 0) {
-    ret = make_error(env, "No such field");
-    goto exit;
+  if (res.is_success) {
+    ret = make_ok(env, res.result);
+  } else {
+    ret = enif_make_tuple2(env, ATOM_ERROR, res.result);
   }
 
-  if (vips_image_get(image, header_name, &gvalue)) {
-    g_value_unset(&gvalue);
-    error("Failed to get GValue. error: %s", vips_error_buffer());
-    vips_error_clear();
-    ret = make_error(env, "Failed to get GValue");
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return ret;
+}
+
+/* Returns a map of `name => {type_name, value}` for the requested
+ * header fields, or for every field when `names` is `:all`. Fields
+ * which do not exist, or can not be converted, are left out */
+ERL_NIF_TERM nif_image_get_headers(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  GObjectResource *gobject_r;
+  VipsImage *image;
+  char header_name[MAX_HEADER_NAME_LENGTH];
+  gchar **fields = NULL;
+  ERL_NIF_TERM list, head, map, ret;
+  ErlNifTime start;
+  VixResult res;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!get_image_resource(env, argv[0], &gobject_r, &image)) {
+    ret = make_error(env, "Failed to get VipsImage");
     goto exit;
   }
 
-  res = g_value_to_erl_term(env, gvalue);
+  map = enif_make_new_map(env);
 
-  if (res.is_success) {
-    type_name = make_binary(env, g_type_name(type));
-    ret = make_ok(env, enif_make_tuple2(env, type_name, res.result));
+  if (enif_is_identical(argv[1], make_atom(env, "all"))) {
+    fields = vips_image_get_fields(image);
+
+    for (int i = 0; fields && fields[i] != NULL; i++) {
+      res = get_header_term(env, gobject_r, image, fields[i]);
+      if (res.is_success)
+        enif_make_map_put(env, map, make_binary(env, fields[i]), res.result,
+                          &map);
+    }
+
+    g_strfreev(fields);
   } else {
-    ret = enif_make_tuple2(env, ATOM_ERROR, res.result);
+    list = argv[1];
+
+    while (enif_get_list_cell(env, list, &head, &list)) {
+      if (!get_binary(env, head, header_name, MAX_HEADER_NAME_LENGTH)) {
+        ret = make_error(env, "Failed to get header name");
+        goto exit;
+      }
+
+      res = get_header_term(env, gobject_r, image, header_name);
+      if (res.is_success)
+        enif_make_map_put(env, map, head, res.result, &map);
+    }
   }
 
+  ret = make_ok(env, map);
+
 exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   return ret;
@@ -843,6 +1144,22 @@ exit:
   return ret;
 }
 
+/* Pixels of images in memory, such as the output of `copy_memory` or
+ * images made from a binary, do not change once the image is built.
+ * Vix only draws on images made by `nif_image_copy_memory_private`,
+ * which are never handed out. Binaries of the whole image can share
+ * the pixels instead of copying them */
+static bool is_in_memory(VipsImage *image) {
+  return (image->dtype == VIPS_IMAGE_SETBUF ||
+          image->dtype == VIPS_IMAGE_SETBUF_FOREIGN) &&
+         image->data && image->Coding == VIPS_CODING_NONE;
+}
+
+static ERL_NIF_TERM image_to_binary_term(ErlNifEnv *env, VipsImage *image) {
+  return to_shared_binary_term(env, (GObject *)image, image->data,
+                               VIPS_IMAGE_SIZEOF_IMAGE(image));
+}
+
 ERL_NIF_TERM nif_image_write_to_binary(ErlNifEnv *env, int argc,
                                        const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
@@ -860,6 +1177,11 @@ ERL_NIF_TERM nif_image_write_to_binary(ErlNifEnv *env, int argc,
     goto exit;
   }
 
+  if (is_in_memory(image)) {
+    ret = make_ok(env, image_to_binary_term(env, image));
+    goto exit;
+  }
+
   bin = vips_image_write_to_memory(image, &size);
 
   if (!bin) {
@@ -877,97 +1199,108 @@ exit:
   return ret;
 }
 
-// Optimized version of fetching raw pixels for a region
-ERL_NIF_TERM nif_image_write_area_to_binary(ErlNifEnv *env, int argc,
-                                            const ERL_NIF_TERM argv[]) {
-  ASSERT_ARGC(argc, 2);
-
-  VipsImage *image;
-  ErlNifTime start;
-  ERL_NIF_TERM list, head, ret;
-  void *bin;
-  size_t size;
+/* Reads `[left, top, width, height, band_start, band_count]`, where -1
+ * means the whole image for that param */
+static bool get_area_params(ErlNifEnv *env, VipsImage *image,
+                            ERL_NIF_TERM list, VipsRect *rect,
+                            int *band_start, int *band_count,
+                            ERL_NIF_TERM *error_term) {
+  ERL_NIF_TERM head;
   guint list_length;
   int params[6] = {0, 0, 0, 0, 0, 0};
-  int left, top, width, height, band_start, band_count;
-  VipsImage **t = NULL;
-
-  start = enif_monotonic_time(ERL_NIF_USEC);
-
-  if (!erl_term_to_g_object(env, argv[0], (GObject **)&image)) {
-    ret = make_error(env, "Failed to get VipsImage");
-    goto exit;
-  }
-
-  list = argv[1];
 
   if (!enif_get_list_length(env, list, &list_length)) {
     error("Failed to get list length");
-    ret = enif_make_badarg(env);
-    goto exit;
+    *error_term = enif_make_badarg(env);
+    return false;
   }
 
   if (list_length != 6) {
     error("Must pass 6 integer params");
-    ret = enif_make_badarg(env);
-    goto exit;
+    *error_term = enif_make_badarg(env);
+    return false;
   }
 
   for (guint i = 0; i < 6; i++) {
     if (!enif_get_list_cell(env, list, &head, &list)) {
-      ret = make_error(env, "Failed to get list entry");
-      goto exit;
+      *error_term = make_error(env, "Failed to get list entry");
+      return false;
     }
 
     if (!enif_get_int(env, head, &params[i])) {
-      ret = make_error(env, "Failed to get int");
-      goto exit;
+      *error_term = make_error(env, "Failed to get int");
+      return false;
     }
   }
 
-  left = params[0];
-  top = params[1];
-  width = params[2];
-  height = params[3];
-  band_start = params[4];
-  band_count = params[5];
+  rect->left = params[0] == -1 ? 0 : params[0];
+  rect->top = params[1] == -1 ? 0 : params[1];
+  rect->width = params[2] == -1 ? vips_image_get_width(image) : params[2];
+  rect->height = params[3] == -1 ? vips_image_get_height(image) : params[3];
+  *band_start = params[4] == -1 ? 0 : params[4];
+  *band_count = params[5] == -1 ? vips_image_get_bands(image) : params[5];
 
-  if (left == -1)
-    left = 0;
+  // vips operations checks boundary, this is just to get better error reporting
+  if (rect->left + rect->width > vips_image_get_width(image) ||
+      rect->top + rect->height > vips_image_get_height(image) ||
+      rect->left < 0 || rect->top < 0 || rect->width <= 0 ||
+      rect->height <= 0 ||
+      *band_start + *band_count > vips_image_get_bands(image) ||
+      *band_start < 0 || *band_count <= 0) {
+    error("Bad extract area, left: %d, top: %d, width: %d, height: %d, "
+          "band_start: %d, band_count: %d",
+          rect->left, rect->top, rect->width, rect->height, *band_start,
+          *band_count);
+    vips_error_clear();
+    *error_term =
+        make_error(env, "Bad extract area. Ensure params are not out of bound");
+    return false;
+  }
 
-  if (top == -1)
-    top = 0;
+  return true;
+}
 
-  if (width == -1)
-    width = vips_image_get_width(image);
+// Optimized version of fetching raw pixels for a region
+ERL_NIF_TERM nif_image_write_area_to_binary(ErlNifEnv *env, int argc,
+                                            const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
 
-  if (height == -1)
-    height = vips_image_get_height(image);
+  VipsImage *image;
+  ErlNifTime start;
+  ERL_NIF_TERM ret;
+  void *bin;
+  size_t size;
+  VipsRect rect;
+  int band_start, band_count;
+  VipsImage **t = NULL;
 
-  if (band_start == -1)
-    band_start = 0;
+  start = enif_monotonic_time(ERL_NIF_USEC);
 
-  if (band_count == -1)
-    band_count = vips_image_get_bands(image);
+  if (!erl_term_to_g_object(env, argv[0], (GObject **)&image)) {
+    ret = make_error(env, "Failed to get VipsImage");
+    goto exit;
+  }
 
-  // vips operations checks boundary, this is just to get better error reporting
-  if (left + width > vips_image_get_width(image) ||
-      top + height > vips_image_get_height(image) || left < 0 || top < 0 ||
-      width <= 0 || height <= 0 ||
-      band_start + band_count > vips_image_get_bands(image) || band_start < 0 ||
-      band_count <= 0) {
-    error("Bad extract area, left: %d, top: %d, width: %d, height: %d, "
-          "band_start: %d, band_count: %d",
-          left, top, width, height, band_start, band_count);
-    vips_error_clear();
-    ret =
-        make_error(env, "Bad extract area. Ensure params are not out of bound");
+  if (!get_area_params(env, image, argv[1], &rect, &band_start, &band_count,
+                       &ret))
+    goto exit;
+
+  if (is_in_memory(image) && rect.left == 0 && rect.top == 0 &&
+      rect.width == image->Xsize && rect.height == image->Ysize &&
+      band_count == image->Bands) {
+    ret = make_ok(env,
+                  enif_make_tuple5(env, image_to_binary_term(env, image),
+                                   enif_make_int(env, image->Xsize),
+                                   enif_make_int(env, image->Ysize),
+                                   enif_make_int(env, image->Bands),
+                                   enif_make_int(env, image->BandFmt)));
     goto exit;
   }
 
   t = VIPS_ARRAY(NULL, 2, VipsImage *);
 
-  if (vips_crop(image, &t[0], left, top, width, height, NULL)) {
+  if (vips_crop(image, &t[0], rect.left, rect.top, rect.width, rect.height,
+                NULL)) {
     error("Failed to extract region. error: %s", vips_error_buffer());
     vips_error_clear();
     ret = make_error(env, "Failed to extract region");
@@ -1011,3 +1344,556 @@ exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   return ret;
 }
+
+typedef struct _VixArea {
+  VipsRect rect;
+  int band_start;
+  int band_count;
+  unsigned char *data;
+  size_t size;
+} VixArea;
+
+typedef struct _VixAreaBatch {
+  VipsImage *image;
+  VixArea *areas;
+  gint n_areas;
+  gint next;
+  gint failed;
+} VixAreaBatch;
+
+/* Each worker has its own region on the shared image and picks the
+ * next pending area until all areas are done or one of them fails */
+static gpointer write_areas_worker(gpointer data) {
+  VixAreaBatch *batch = (VixAreaBatch *)data;
+  VipsRegion *region;
+  VixArea *area;
+  size_t sizeof_element, sizeof_pel, row_size;
+  unsigned char *dst, *src;
+  gint i;
+
+  sizeof_element = VIPS_IMAGE_SIZEOF_ELEMENT(batch->image);
+  sizeof_pel = VIPS_IMAGE_SIZEOF_PEL(batch->image);
+
+  region = vips_region_new(batch->image);
+
+  while (!g_atomic_int_get(&batch->failed)) {
+    i = g_atomic_int_add(&batch->next, 1);
+    if (i >= batch->n_areas)
+      break;
+
+    area = &batch->areas[i];
+
+    if (vips_region_prepare(region, &area->rect)) {
+      g_atomic_int_set(&batch->failed, 1);
+      break;
+    }
+
+    dst = area->data;
+    row_size = (size_t)area->band_count * sizeof_element;
+
+    for (int y = 0; y < area->rect.height; y++) {
+      src = (unsigned char *)VIPS_REGION_ADDR(region, area->rect.left,
+                                              area->rect.top + y);
+
+      if (area->band_count == vips_image_get_bands(batch->image)) {
+        memcpy(dst, src, (size_t)area->rect.width * sizeof_pel);
+        dst += (size_t)area->rect.width * sizeof_pel;
+      } else {
+        src += (size_t)area->band_start * sizeof_element;
+
+        for (int x = 0; x < area->rect.width; x++) {
+          memcpy(dst, src, row_size);
+          dst += row_size;
+          src += sizeof_pel;
+        }
+      }
+    }
+  }
+
+  g_object_unref(region);
+  return NULL;
+}
+
+/* Prepares an image which can be read concurrently by many regions.
+ * Images which are not in memory get a threaded tile cache, so
+ * overlapping areas compute the shared tiles only once */
+static int prepare_areas_source(VipsImage *image, VipsImage **out) {
+  VipsImage *decoded;
+  int ret;
+
+  if (vips_image_decode(image, &decoded))
+    return -1;
+
+  if (decoded->data) {
+    *out = decoded;
+    return 0;
+  }
+
+  ret = vips_tilecache(decoded, out, "threaded", TRUE, NULL);
+  g_object_unref(decoded);
+
+  return ret;
+}
+
+/* Batched version of `nif_image_write_area_to_binary`. Takes a list of
+ * area params and returns `[{binary, width, height, bands}]`, or with
+ * `contiguous` set, a single binary with `[{offset, size, width, height,
+ * bands}]`. Band format is returned once since it is same for all */
+ERL_NIF_TERM nif_image_write_areas_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 3);
+
+  VipsImage *image;
+  VipsImage *source = NULL;
+  VixAreaBatch batch = {0};
+  VixArea *area;
+  ErlNifBinary *bins = NULL;
+  ErlNifBinary contiguous_bin;
+  ERL_NIF_TERM list, head, ret, *terms = NULL;
+  ErlNifTime start;
+  guint n_areas = 0, n_bins = 0, n_threads;
+  size_t sizeof_element, total_size = 0;
+  bool contiguous;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!erl_term_to_g_object(env, argv[0], (GObject **)&image)) {
+    ret = make_error(env, "Failed to get VipsImage");
+    goto exit;
+  }
+
+  if (!enif_get_list_length(env, argv[1], &n_areas) || n_areas == 0) {
+    ret = make_error(env, "Areas must be a non-empty list");
+    goto exit;
+  }
+
+  contiguous = enif_is_identical(argv[2], ATOM_TRUE);
+
+  if (prepare_areas_source(image, &source)) {
+    error("Failed to prepare image. error: %s", vips_error_buffer());
+    vips_error_clear();
+    ret = make_error(env, "Failed to prepare image");
+    goto exit;
+  }
+
+  sizeof_element = VIPS_IMAGE_SIZEOF_ELEMENT(source);
+
+  batch.image = source;
+  batch.n_areas = (gint)n_areas;
+  batch.areas = g_new0(VixArea, n_areas);
+
+  list = argv[1];
+
+  for (guint i = 0; i < n_areas; i++) {
+    area = &batch.areas[i];
+
+    enif_get_list_cell(env, list, &head, &list);
+
+    if (!get_area_params(env, source, head, &area->rect, &area->band_start,
+                         &area->band_count, &ret))
+      goto free_and_exit;
+
+    area->size = (size_t)area->rect.width * area->rect.height *
+                 area->band_count * sizeof_element;
+    total_size += area->size;
+  }
+
+  // all destinations are allocated upfront, workers only copy pixels
+  if (contiguous) {
+    if (!enif_alloc_binary(total_size, &contiguous_bin)) {
+      ret = make_error(env, "Failed to allocate binary");
+      goto free_and_exit;
+    }
+
+    n_bins = 1;
+    total_size = 0;
+
+    for (guint i = 0; i < n_areas; i++) {
+      batch.areas[i].data = contiguous_bin.data + total_size;
+      total_size += batch.areas[i].size;
+    }
+  } else {
+    bins = g_new(ErlNifBinary, n_areas);
+
+    for (n_bins = 0; n_bins < n_areas; n_bins++) {
+      if (!enif_alloc_binary(batch.areas[n_bins].size, &bins[n_bins])) {
+        ret = make_error(env, "Failed to allocate binary");
+        goto free_and_exit;
+      }
+
+      batch.areas[n_bins].data = bins[n_bins].data;
+    }
+  }
+
+  // calling thread works too, so ask for one less helper
+  n_threads = MIN((guint)vips_concurrency_get(), n_areas);
+  parallel_run(write_areas_worker, &batch, n_threads - 1);
+
+  if (batch.failed) {
+    error("Failed to write areas to memory. error: %s", vips_error_buffer());
+    vips_error_clear();
+    ret = make_error(env, "Failed to write areas to memory");
+    goto free_and_exit;
+  }
+
+  terms = g_new(ERL_NIF_TERM, n_areas);
+  total_size = 0;
+
+  for (guint i = 0; i < n_areas; i++) {
+    area = &batch.areas[i];
+
+    if (contiguous) {
+      terms[i] = enif_make_tuple5(
+          env, enif_make_uint64(env, total_size),
+          enif_make_uint64(env, area->size),
+          enif_make_int(env, area->rect.width),
+          enif_make_int(env, area->rect.height),
+          enif_make_int(env, area->band_count));
+      total_size += area->size;
+    } else {
+      terms[i] = enif_make_tuple4(env, enif_make_binary(env, &bins[i]),
+                                  enif_make_int(env, area->rect.width),
+                                  enif_make_int(env, area->rect.height),
+                                  enif_make_int(env, area->band_count));
+    }
+  }
+
+  list = enif_make_list_from_array(env, terms, n_areas);
+
+  if (contiguous) {
+    ret = make_ok(env, enif_make_tuple3(
+                           env, enif_make_binary(env, &contiguous_bin), list,
+                           enif_make_int(env, vips_image_get_format(source))));
+  } else {
+    ret = make_ok(env, enif_make_tuple2(
+                           env, list,
+                           enif_make_int(env, vips_image_get_format(source))));
+  }
+
+  // ownership of the binaries is transferred to the terms
+  n_bins = 0;
+
+free_and_exit:
+  if (contiguous && n_bins > 0) {
+    enif_release_binary(&contiguous_bin);
+  } else {
+    for (guint i = 0; i < n_bins; i++)
+      enif_release_binary(&bins[i]);
+  }
+
+  g_free(bins);
+  g_free(terms);
+  g_free(batch.areas);
+  g_object_unref(source);
+
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return ret;
+}
+
+typedef struct _VixTensorBatch {
+  VipsImage **images;
+  gint n_images;
+  gint next;
+  int width;
+  int height;
+  int bands;
+  bool channels_first;
+  bool double_output;
+  /* per element of a row for channels last, per band for channels first */
+  void *mean;
+  void *scale;
+  /* in elements */
+  size_t plane_size;
+  /* in bytes */
+  size_t row_stride;
+  size_t image_size;
+  unsigned char *data;
+} VixTensorBatch;
+
+typedef void (*ConvertRowFn)(const VixTensorBatch *batch, const void *src_row,
+                             void *dst_row);
+
+/* Writes `(src - mean) * scale` for a row of pixels. Channels last rows
+ * are a single contiguous loop, mean and scale are repeated for each
+ * pixel. Channels first rows are written band by band to their plane */
+#define DEFINE_CONVERT_ROW(NAME, SRC_TYPE, DST_TYPE)                           \
+  static void NAME(const VixTensorBatch *batch, const void *src_row,           \
+                   void *dst_row) {                                            \
+    const SRC_TYPE *restrict src = src_row;                                    \
+    DST_TYPE *restrict dst = dst_row;                                          \
+    const DST_TYPE *restrict mean = batch->mean;                               \
+    const DST_TYPE *restrict scale = batch->scale;                             \
+    size_t width = (size_t)batch->width, bands = (size_t)batch->bands;         \
+                                                                               \
+    if (batch->channels_first) {                                               \
+      for (size_t b = 0; b < bands; b++, dst += batch->plane_size)             \
+        for (size_t x = 0; x < width; x++)                                     \
+          dst[x] = ((DST_TYPE)src[x * bands + b] - mean[b]) * scale[b];        \
+    } else {                                                                   \
+      for (size_t i = 0; i < width * bands; i++)                               \
+        dst[i] = ((DST_TYPE)src[i] - mean[i]) * scale[i];                      \
+    }                                                                          \
+  }
+
+DEFINE_CONVERT_ROW(convert_row_uchar_float, guint8, float)
+DEFINE_CONVERT_ROW(convert_row_char_float, gint8, float)
+DEFINE_CONVERT_ROW(convert_row_ushort_float, guint16, float)
+DEFINE_CONVERT_ROW(convert_row_short_float, gint16, float)
+DEFINE_CONVERT_ROW(convert_row_uint_float, guint32, float)
+DEFINE_CONVERT_ROW(convert_row_int_float, gint32, float)
+DEFINE_CONVERT_ROW(convert_row_float_float, float, float)
+DEFINE_CONVERT_ROW(convert_row_double_float, double, float)
+
+DEFINE_CONVERT_ROW(convert_row_uchar_double, guint8, double)
+DEFINE_CONVERT_ROW(convert_row_char_double, gint8, double)
+DEFINE_CONVERT_ROW(convert_row_ushort_double, guint16, double)
+DEFINE_CONVERT_ROW(convert_row_short_double, gint16, double)
+DEFINE_CONVERT_ROW(convert_row_uint_double, guint32, double)
+DEFINE_CONVERT_ROW(convert_row_int_double, gint32, double)
+DEFINE_CONVERT_ROW(convert_row_float_double, float, double)
+DEFINE_CONVERT_ROW(convert_row_double_double, double, double)
+
+/* indexed by source band format and `double_output`, complex formats
+ * are not supported */
+static const ConvertRowFn CONVERT_ROW[VIPS_FORMAT_LAST][2] = {
+    [VIPS_FORMAT_UCHAR] = {convert_row_uchar_float, convert_row_uchar_double},
+    [VIPS_FORMAT_CHAR] = {convert_row_char_float, convert_row_char_double},
+    [VIPS_FORMAT_USHORT] = {convert_row_ushort_float,
+                            convert_row_ushort_double},
+    [VIPS_FORMAT_SHORT] = {convert_row_short_float, convert_row_short_double},
+    [VIPS_FORMAT_UINT] = {convert_row_uint_float, convert_row_uint_double},
+    [VIPS_FORMAT_INT] = {convert_row_int_float, convert_row_int_double},
+    [VIPS_FORMAT_FLOAT] = {convert_row_float_float, convert_row_float_double},
+    [VIPS_FORMAT_DOUBLE] = {convert_row_double_float,
+                            convert_row_double_double},
+};
+
+static ConvertRowFn find_convert_row(VipsImage *image, bool double_output) {
+  VipsBandFormat format = vips_image_get_format(image);
+
+  if (format < 0 || format >= VIPS_FORMAT_LAST)
+    return NULL;
+
+  return CONVERT_ROW[format][double_output];
+}
+
+/* Images are already in memory, so workers only convert pixels. Each
+ * worker picks the next pending image until all are done */
+static gpointer write_tensor_worker(gpointer data) {
+  VixTensorBatch *batch = (VixTensorBatch *)data;
+  VipsImage *image;
+  ConvertRowFn convert_row;
+  unsigned char *dst;
+  gint i;
+
+  while ((i = g_atomic_int_add(&batch->next, 1)) < batch->n_images) {
+    image = batch->images[i];
+    convert_row = find_convert_row(image, batch->double_output);
+    dst = batch->data + (size_t)i * batch->image_size;
+
+    for (int y = 0; y < batch->height; y++) {
+      convert_row(batch, VIPS_IMAGE_ADDR(image, 0, y), dst);
+      dst += batch->row_stride;
+    }
+  }
+
+  return NULL;
+}
+
+/* Images not in memory are computed with the libvips threadpool, one
+ * after the other, before the conversion starts */
+static int prepare_tensor_source(VipsImage *image, VipsImage **out) {
+  VipsImage *decoded;
+
+  if (vips_image_decode(image, &decoded))
+    return -1;
+
+  if (decoded->data) {
+    *out = decoded;
+    return 0;
+  }
+
+  *out = vips_image_copy_memory(decoded);
+  g_object_unref(decoded);
+
+  return *out ? 0 : -1;
+}
+
+/* Reads a list of 1 or `bands` numbers and writes them to `values` as
+ * `float` or `double`, repeated `repeat` times */
+static bool get_band_values(ErlNifEnv *env, ERL_NIF_TERM list, int bands,
+                            int repeat, bool double_output, bool inverse,
+                            void **values) {
+  ERL_NIF_TERM head;
+  guint length;
+  double *value;
+  size_t n = (size_t)bands * repeat;
+
+  if (!enif_get_list_length(env, list, &length) ||
+      (length != 1 && length != (guint)bands))
+    return false;
+
+  value = g_new(double, bands);
+
+  for (int b = 0; b < bands; b++) {
+    if (b < (int)length) {
+      enif_get_list_cell(env, list, &head, &list);
+
+      if (!enif_get_double(env, head, &value[b])) {
+        g_free(value);
+        return false;
+      }
+
+      if (inverse)
+        value[b] = 1.0 / value[b];
+    } else {
+      value[b] = value[0];
+    }
+  }
+
+  if (double_output) {
+    double *dst = g_new(double, n);
+    for (size_t i = 0; i < n; i++)
+      dst[i] = value[i % bands];
+    *values = dst;
+  } else {
+    float *dst = g_new(float, n);
+    for (size_t i = 0; i < n; i++)
+      dst[i] = (float)value[i % bands];
+    *values = dst;
+  }
+
+  g_free(value);
+  return true;
+}
+
+/* Writes a list of images with the same width, height and bands to a
+ * single binary, as `float` or `double` normalized by per band `mean`
+ * and `std`, in either NHWC or NCHW layout. Returns `{binary, n, height,
+ * width, bands}` */
+ERL_NIF_TERM nif_image_write_batch_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 5);
+
+  VipsImage *image;
+  VixTensorBatch batch = {0};
+  ErlNifBinary bin;
+  ERL_NIF_TERM list, head, ret;
+  ErlNifTime start;
+  guint n_images = 0, n_threads;
+  int band_format, repeat;
+  size_t sizeof_element;
+  bool bin_allocated = false;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!enif_get_list_length(env, argv[0], &n_images) || n_images == 0) {
+    ret = make_error(env, "Images must be a non-empty list");
+    goto exit;
+  }
+
+  if (!enif_get_int(env, argv[2], &band_format) ||
+      (band_format != VIPS_FORMAT_FLOAT && band_format != VIPS_FORMAT_DOUBLE)) {
+    error("Band format must be float or double");
+    ret = enif_make_badarg(env);
+    goto exit;
+  }
+
+  batch.channels_first = enif_is_identical(argv[1], ATOM_TRUE);
+  batch.double_output = band_format == VIPS_FORMAT_DOUBLE;
+  batch.n_images = (gint)n_images;
+  batch.images = g_new0(VipsImage *, n_images);
+
+  list = argv[0];
+
+  for (guint i = 0; i < n_images; i++) {
+    enif_get_list_cell(env, list, &head, &list);
+
+    if (!erl_term_to_g_object(env, head, (GObject **)&image)) {
+      ret = make_error(env, "Failed to get VipsImage");
+      goto free_and_exit;
+    }
+
+    if (prepare_tensor_source(image, &batch.images[i])) {
+      error("Failed to write image to memory. error: %s", vips_error_buffer());
+      vips_error_clear();
+      ret = make_error(env, "Failed to write image to memory");
+      goto free_and_exit;
+    }
+
+    image = batch.images[i];
+
+    if (i == 0) {
+      batch.width = vips_image_get_width(image);
+      batch.height = vips_image_get_height(image);
+      batch.bands = vips_image_get_bands(image);
+    } else if (vips_image_get_width(image) != batch.width ||
+               vips_image_get_height(image) != batch.height ||
+               vips_image_get_bands(image) != batch.bands) {
+      ret = make_error(env,
+                       "Images must have the same width, height and bands");
+      goto free_and_exit;
+    }
+
+    if (!find_convert_row(image, batch.double_output)) {
+      ret = make_error(env, "Complex band formats are not supported");
+      goto free_and_exit;
+    }
+  }
+
+  repeat = batch.channels_first ? 1 : batch.width;
+
+  if (!get_band_values(env, argv[3], batch.bands, repeat, batch.double_output,
+                       false, &batch.mean) ||
+      !get_band_values(env, argv[4], batch.bands, repeat, batch.double_output,
+                       true, &batch.scale)) {
+    error("Mean and std must be lists of 1 or bands numbers");
+    ret = enif_make_badarg(env);
+    goto free_and_exit;
+  }
+
+  sizeof_element = batch.double_output ? sizeof(double) : sizeof(float);
+
+  batch.plane_size = (size_t)batch.width * batch.height;
+  batch.row_stride = (size_t)batch.width * sizeof_element *
+                     (batch.channels_first ? 1 : batch.bands);
+  batch.image_size = batch.plane_size * batch.bands * sizeof_element;
+
+  if (!enif_alloc_binary(batch.image_size * n_images, &bin)) {
+    ret = make_error(env, "Failed to allocate binary");
+    goto free_and_exit;
+  }
+
+  bin_allocated = true;
+  batch.data = bin.data;
+
+  // calling thread works too, so ask for one less helper
+  n_threads = MIN((guint)vips_concurrency_get(), n_images);
+  parallel_run(write_tensor_worker, &batch, n_threads - 1);
+
+  ret = make_ok(env, enif_make_tuple5(env, enif_make_binary(env, &bin),
+                                      enif_make_uint(env, n_images),
+                                      enif_make_int(env, batch.height),
+                                      enif_make_int(env, batch.width),
+                                      enif_make_int(env, batch.bands)));
+
+  // ownership of the binary is transferred to the term
+  bin_allocated = false;
+
+free_and_exit:
+  if (bin_allocated)
+    enif_release_binary(&bin);
+
+  for (guint i = 0; i < n_images; i++)
+    if (batch.images[i])
+      g_object_unref(batch.images[i]);
+
+  g_free(batch.images);
+  g_free(batch.mean);
+  g_free(batch.scale);
+
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return ret;
+}
@@ -12,6 +12,9 @@ ERL_NIF_TERM nif_image_new_from_image(ErlNifEnv *env, int argc,
 ERL_NIF_TERM nif_image_copy_memory(ErlNifEnv *env, int argc,
                                    const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_image_copy_memory_private(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_image_write_to_file(ErlNifEnv *env, int argc,
                                      const ERL_NIF_TERM argv[]);
 
@@ -26,12 +29,18 @@ ERL_NIF_TERM nif_image_new_temp_file(ErlNifEnv *env, int argc,
 ERL_NIF_TERM nif_image_new_matrix_from_array(ErlNifEnv *env, int argc,
                                              const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_image_new_matrix_from_binary(ErlNifEnv *env, int argc,
+                                              const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_image_get_fields(ErlNifEnv *env, int argc,
                                   const ERL_NIF_TERM argv[]);
 
 ERL_NIF_TERM nif_image_get_header(ErlNifEnv *env, int argc,
                                   const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_image_get_headers(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_image_get_as_string(ErlNifEnv *env, int argc,
                                      const ERL_NIF_TERM argv[]);
 
@@ -61,4 +70,11 @@ ERL_NIF_TERM nif_image_write_to_binary(ErlNifEnv *env, int argc,
 
 ERL_NIF_TERM nif_image_write_area_to_binary(ErlNifEnv *env, int argc,
                                             const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_image_write_areas_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_image_write_batch_to_binary(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]);
+
 #endif
@@ -1,7 +1,10 @@
 #include <glib-object.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <vips/vips.h>
 
+#include "cancel.h"
 #include "g_object/g_boxed.h"
 #include "g_object/g_object.h"
 #include "g_object/g_param_spec.h"
@@ -25,54 +28,168 @@ typedef struct _GTypeList {
   unsigned int count;
 } GTypeList;
 
-typedef struct _VipsNameFlagsPair {
-  const char **names;
-  int *flags;
-} VipsNameFlagsPair;
+/* Latency histogram bucket `i` counts calls which took less than
+ * 2^i microseconds (and at least 2^(i-1)), the last bucket is open */
+#define VIX_STATS_BUCKETS 24
+
+/* Updated with relaxed atomics from any scheduler or pool thread. The
+ * counters are independent, so a reader might see a call counted in
+ * `calls` but not yet in `histogram`, which is fine for monitoring */
+typedef struct _VixOperationStats {
+  atomic_uint_fast64_t calls;
+  atomic_uint_fast64_t errors;
+  atomic_uint_fast64_t total_us;
+  atomic_uint_fast64_t histogram[VIX_STATS_BUCKETS];
+} VixOperationStats;
+
+/* Resolved argument table of an operation class, built once per
+ * nickname on first use. Erlang side refers to an argument by its
+ * index in this table instead of the name. The class is never
+ * unreffed, so the GParamSpecs stay valid for the lifetime of the VM */
+typedef struct _VixOperationPlan {
+  GType type;
+  const char *description;
+  guint n_args;
+  GParamSpec **pspecs;
+  VipsArgumentFlags *flags;
+  int *priorities;
+  guint n_outputs;
+  guint *outputs;
+  VixOperationStats stats;
+} VixOperationPlan;
+
+static GHashTable *operation_plans;
+static ErlNifRWLock *operation_plans_lock;
+
+static void *collect_plan_argument(VipsObjectClass *object_class,
+                                   GParamSpec *pspec,
+                                   VipsArgumentClass *argument_class, void *a,
+                                   void *b) {
+  VixOperationPlan *plan = (VixOperationPlan *)a;
+  guint i = plan->n_args;
+
+  plan->pspecs[i] = pspec;
+  plan->flags[i] = argument_class->flags;
+  plan->priorities[i] = argument_class->priority;
+
+  if (argument_class->flags & VIPS_ARGUMENT_OUTPUT) {
+    plan->outputs[plan->n_outputs] = i;
+    plan->n_outputs += 1;
+  }
 
-static void *vips_object_find_args(VipsObject *object, GParamSpec *pspec,
-                                   VipsArgumentClass *argument_class,
-                                   VipsArgumentInstance *argument_instance,
-                                   void *a, void *b) {
-  VipsNameFlagsPair *pair = (VipsNameFlagsPair *)a;
-  int *i = (int *)b;
+  plan->n_args += 1;
 
-  pair->names[*i] = g_param_spec_get_name(pspec);
-  pair->flags[*i] = (int)argument_class->flags;
+  return (NULL);
+}
 
-  *i += 1;
+static VixOperationPlan *build_operation_plan(const char *nickname) {
+  GType type;
+  VipsObjectClass *class;
+  VixOperationPlan *plan;
+  guint n;
 
-  return (NULL);
+  type = vips_type_find("VipsOperation", nickname);
+  if (!type) {
+    vips_error("VipsOperation", "class \"%s\" not found", nickname);
+    return NULL;
+  }
+
+  if (G_TYPE_IS_ABSTRACT(type)) {
+    vips_error("VipsOperation", "\"%s\" is not an instantiable class",
+               nickname);
+    return NULL;
+  }
+
+  class = VIPS_OBJECT_CLASS(g_type_class_ref(type));
+  n = g_slist_length(class->argument_table_traverse);
+
+  plan = g_new0(VixOperationPlan, 1);
+  plan->type = type;
+  plan->description = class->description;
+  plan->pspecs = g_new(GParamSpec *, n);
+  plan->flags = g_new(VipsArgumentFlags, n);
+  plan->priorities = g_new(int, n);
+  plan->outputs = g_new(guint, n);
+
+  vips_argument_class_map(class, collect_plan_argument, plan, NULL);
+
+  return plan;
 }
 
-static int get_vips_operation_args(VipsOperation *op, const char ***names,
-                                   int **flags, int *n_args) {
-  VipsObject *object;
-  VipsObjectClass *object_class;
-  VipsNameFlagsPair pair;
-  int n, i;
+static VixOperationPlan *get_operation_plan(const char *nickname) {
+  VixOperationPlan *plan;
+
+  enif_rwlock_rlock(operation_plans_lock);
+  plan = g_hash_table_lookup(operation_plans, nickname);
+  enif_rwlock_runlock(operation_plans_lock);
 
-  object = VIPS_OBJECT(op);
+  if (plan)
+    return plan;
 
-  object_class = VIPS_OBJECT_GET_CLASS(object);
-  n = g_slist_length(object_class->argument_table_traverse);
+  enif_rwlock_rwlock(operation_plans_lock);
 
-  pair.names = VIPS_ARRAY(object, n, const char *);
-  pair.flags = VIPS_ARRAY(object, n, int);
-  if (!pair.names || !pair.flags)
-    return (-1);
+  // another thread might have built it while we were waiting
+  plan = g_hash_table_lookup(operation_plans, nickname);
 
-  i = 0;
-  (void)vips_argument_map(object, vips_object_find_args, &pair, &i);
+  if (!plan) {
+    plan = build_operation_plan(nickname);
+    if (plan)
+      g_hash_table_insert(operation_plans, g_strdup(nickname), plan);
+  }
 
-  if (names)
-    *names = pair.names;
-  if (flags)
-    *flags = pair.flags;
-  if (n_args)
-    *n_args = n;
+  enif_rwlock_rwunlock(operation_plans_lock);
 
-  return (0);
+  return plan;
+}
+
+static void record_operation_stats(VixOperationPlan *plan, ErlNifTime start,
+                                   bool is_success) {
+  VixOperationStats *stats = &plan->stats;
+  ErlNifTime elapsed;
+  guint bucket = 0;
+
+  elapsed = enif_monotonic_time(ERL_NIF_USEC) - start;
+  if (elapsed < 0)
+    elapsed = 0;
+
+  while (bucket < VIX_STATS_BUCKETS - 1 && (elapsed >> bucket) > 0)
+    bucket++;
+
+  atomic_fetch_add_explicit(&stats->calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->total_us, (uint_fast64_t)elapsed,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->histogram[bucket], 1,
+                            memory_order_relaxed);
+
+  if (!is_success)
+    atomic_fetch_add_explicit(&stats->errors, 1, memory_order_relaxed);
+}
+
+static ERL_NIF_TERM operation_stats_to_term(ErlNifEnv *env,
+                                            const char *nickname,
+                                            VixOperationStats *stats) {
+  ERL_NIF_TERM histogram[VIX_STATS_BUCKETS];
+  uint_fast64_t count;
+
+  for (guint i = 0; i < VIX_STATS_BUCKETS; i++) {
+    count = atomic_load_explicit(&stats->histogram[i], memory_order_relaxed);
+    histogram[i] = enif_make_uint64(env, count);
+  }
+
+  return enif_make_tuple5(
+      env, make_binary(env, nickname),
+      enif_make_uint64(env, atomic_load_explicit(&stats->calls,
+                                                 memory_order_relaxed)),
+      enif_make_uint64(env, atomic_load_explicit(&stats->errors,
+                                                 memory_order_relaxed)),
+      enif_make_uint64(env, atomic_load_explicit(&stats->total_us,
+                                                 memory_order_relaxed)),
+      enif_make_list_from_array(env, histogram, VIX_STATS_BUCKETS));
+}
+
+static VipsOperation *new_operation_from_plan(VixOperationPlan *plan) {
+  // same as `vips_operation_new`, minus the nickname lookup
+  return VIPS_OPERATION(g_object_new(plan->type, NULL));
 }
 
 static ERL_NIF_TERM vips_argument_flags_to_erl_terms(ErlNifEnv *env,
@@ -108,60 +225,103 @@ static ERL_NIF_TERM vips_argument_flags_to_erl_terms(ErlNifEnv *env,
   return list;
 }
 
-static VixResult get_operation_properties(ErlNifEnv *env, VipsOperation *op) {
+static VixResult get_operation_properties(ErlNifEnv *env, VipsOperation *op,
+                                          VixOperationPlan *plan) {
+  ERL_NIF_TERM list, entry;
+  GParamSpec *pspec;
+  VixResult res;
+  guint index;
 
-  const char **names;
-  int *flags;
-  int n_args = 0;
+  list = enif_make_list(env, 0);
 
-  ERL_NIF_TERM list, name, entry;
-  GParamSpec *pspec;
+  for (guint i = 0; i < plan->n_outputs; i++) {
+    index = plan->outputs[i];
+    pspec = plan->pspecs[index];
+
+    res = get_erl_term_from_g_object_property(
+        env, G_OBJECT(op), g_param_spec_get_name(pspec), pspec);
+
+    // early exit is fine, for already reffed output GObjects
+    // since `g_object_dtor` takes care of unreffing
+    if (!res.is_success)
+      return res;
+
+    entry = enif_make_tuple2(env, enif_make_uint(env, index), res.result);
+    list = enif_make_list_cell(env, entry, list);
+  }
+
+  SET_VIX_RESULT(res, list);
+  return res;
+}
+
+/* Pipeline arguments can reference an output of an already built node
+ * as `{node_index, output_name}`. None of the regular argument terms
+ * are tuples, so the shape alone is enough to tell them apart */
+static VixResult set_g_value_from_node_output(ErlNifEnv *env, GParamSpec *pspec,
+                                              ERL_NIF_TERM term,
+                                              VipsOperation **nodes,
+                                              guint n_nodes, GValue *gvalue) {
+  VixResult res;
+  const ERL_NIF_TERM *tup;
+  int count;
+  guint index;
+  char name[1024];
+  GParamSpec *src_pspec;
   VipsArgumentClass *arg_class;
   VipsArgumentInstance *arg_instance;
-  VixResult res;
 
-  if (get_vips_operation_args(op, &names, &flags, &n_args)) {
-    SET_RESULT_FROM_VIPS_ERROR(env, "failed to get output fields", res);
+  if (!enif_get_tuple(env, term, &count, &tup) || count != 2) {
+    SET_ERROR_RESULT(env, "invalid node output reference", res);
     return res;
   }
 
-  list = enif_make_list(env, 0);
-
-  for (int i = 0; i < n_args; i++) {
-    if (flags[i] & VIPS_ARGUMENT_OUTPUT) {
-      if (vips_object_get_argument(VIPS_OBJECT(op), names[i], &pspec,
-                                   &arg_class, &arg_instance)) {
-        error("failed to get argument: %s", names[i]);
-        SET_RESULT_FROM_VIPS_ERROR(env, names[i], res);
-        // early exit is fine, for already reffed output GObjects
-        // since `g_object_dtor` takes care of unreffing
-        return res;
-      }
+  if (!enif_get_uint(env, tup[0], &index) || index >= n_nodes) {
+    SET_ERROR_RESULT(env, "node output must refer to an earlier node", res);
+    return res;
+  }
 
-      res = get_erl_term_from_g_object_property(env, G_OBJECT(op), names[i],
-                                                pspec);
+  if (!get_binary(env, tup[1], name, 1024)) {
+    SET_ERROR_RESULT(env, "failed to get node output name", res);
+    return res;
+  }
 
-      if (!res.is_success)
-        return res;
+  if (vips_object_get_argument(VIPS_OBJECT(nodes[index]), name, &src_pspec,
+                               &arg_class, &arg_instance) ||
+      !(arg_class->flags & VIPS_ARGUMENT_OUTPUT)) {
+    vips_error_clear();
+    SET_ERROR_RESULT(env, "referenced node output does not exist", res);
+    return res;
+  }
 
-      name = make_binary(env, names[i]);
-      entry = enif_make_tuple2(env, name, res.result);
-      list = enif_make_list_cell(env, entry, list);
-    }
+  if (!g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(src_pspec),
+                   G_PARAM_SPEC_VALUE_TYPE(pspec))) {
+    SET_ERROR_RESULT(env, "node output type does not match the argument",
+                     res);
+    return res;
   }
 
-  SET_VIX_RESULT(res, list);
+  g_value_init(gvalue, G_PARAM_SPEC_VALUE_TYPE(src_pspec));
+  g_object_get_property(G_OBJECT(nodes[index]), name, gvalue);
+
+  SET_VIX_RESULT(res, ATOM_OK);
   return res;
 }
 
+/* Arguments are `{index, value}` where index refers to the plan
+ * entry. Binary argument names are accepted as well */
 static VixResult set_operation_properties(ErlNifEnv *env, VipsOperation *op,
-                                          ERL_NIF_TERM list) {
+                                          VixOperationPlan *plan,
+                                          ERL_NIF_TERM list,
+                                          VipsOperation **nodes,
+                                          guint n_nodes) {
   guint length = 0;
   ERL_NIF_TERM head;
   VixResult res;
-  const ERL_NIF_TERM *tup;
+  const ERL_NIF_TERM *tup, *tup_value;
   int count;
-  char name[1024];
+  guint index;
+  char name_buf[1024];
+  const char *name;
   GParamSpec *pspec;
   VipsArgumentClass *arg_class;
   VipsArgumentInstance *arg_instance;
@@ -189,17 +349,34 @@ static VixResult set_operation_properties(ErlNifEnv *env, VipsOperation *op,
       return res;
     }
 
-    if (!get_binary(env, tup[0], name, 1024)) {
-      SET_ERROR_RESULT(env, "failed to get param name", res);
-      return res;
-    }
-    if (vips_object_get_argument(VIPS_OBJECT(op), name, &pspec, &arg_class,
-                                 &arg_instance)) {
-      SET_ERROR_RESULT(env, "failed to get vips argument", res);
-      return res;
+    if (enif_get_uint(env, tup[0], &index)) {
+      if (index >= plan->n_args || !(plan->flags[index] & VIPS_ARGUMENT_INPUT)) {
+        SET_ERROR_RESULT(env, "invalid argument index", res);
+        return res;
+      }
+
+      pspec = plan->pspecs[index];
+      name = g_param_spec_get_name(pspec);
+    } else {
+      if (!get_binary(env, tup[0], name_buf, 1024)) {
+        SET_ERROR_RESULT(env, "failed to get param name", res);
+        return res;
+      }
+      if (vips_object_get_argument(VIPS_OBJECT(op), name_buf, &pspec,
+                                   &arg_class, &arg_instance)) {
+        SET_ERROR_RESULT(env, "failed to get vips argument", res);
+        return res;
+      }
+
+      name = name_buf;
     }
 
-    res = set_g_value_from_erl_term(env, pspec, tup[1], &gvalue);
+    if (nodes && enif_get_tuple(env, tup[1], &count, &tup_value))
+      res = set_g_value_from_node_output(env, pspec, tup[1], nodes, n_nodes,
+                                         &gvalue);
+    else
+      res = set_g_value_from_erl_term(env, pspec, tup[1], &gvalue);
+
     if (!res.is_success)
       return res;
 
@@ -211,44 +388,90 @@ static VixResult set_operation_properties(ErlNifEnv *env, VipsOperation *op,
   return res;
 }
 
-ERL_NIF_TERM nif_vips_operation_call(ErlNifEnv *env, int argc,
-                                     const ERL_NIF_TERM argv[]) {
+/* Replace every input image of the operation with a copy which is
+ * killed once the token is cancelled. Images modified in place are left
+ * as is, since the copy would be modified instead */
+static bool watch_input_images(VipsOperation *op, VixOperationPlan *plan,
+                               VixCancelToken *token,
+                               VixCancelWatch *watches) {
+  VipsImage *image;
+  VipsImage *copy;
+  GParamSpec *pspec;
+  guint i;
+
+  for (i = 0; i < plan->n_args; i++) {
+    pspec = plan->pspecs[i];
+
+    if (!(plan->flags[i] & VIPS_ARGUMENT_INPUT) ||
+        (plan->flags[i] & VIPS_ARGUMENT_MODIFY) ||
+        !g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE))
+      continue;
+
+    image = NULL;
+    g_object_get(op, g_param_spec_get_name(pspec), &image, NULL);
+
+    if (!image)
+      continue;
+
+    copy = cancel_watch_image(token, image, &watches[i]);
+    g_object_unref(image);
+
+    if (!copy)
+      return false;
+
+    g_object_set(op, g_param_spec_get_name(pspec), copy, NULL);
+  }
+
+  return true;
+}
+
+static VixResult call_operation(ErlNifEnv *env, VixOperationPlan *plan,
+                                ERL_NIF_TERM args, VixCancelToken *token) {
   VixResult res;
-  VipsOperation *op = NULL;
+  VipsOperation *op;
   VipsOperation *new_op;
+  VixCancelWatch *watches = NULL;
   ErlNifTime start;
-  char op_name[200] = {0};
+  guint i;
 
   start = enif_monotonic_time(ERL_NIF_USEC);
 
-  ASSERT_ARGC(argc, 2);
+  op = new_operation_from_plan(plan);
 
-  if (!get_binary(env, argv[0], op_name, 200)) {
-    SET_ERROR_RESULT(env, "operation name must be a valid string", res);
-    goto exit;
-  }
+  res = set_operation_properties(env, op, plan, args, NULL, 0);
+  if (!res.is_success)
+    goto free_and_exit;
 
-  op = vips_operation_new(op_name);
-  if (!op) {
-    SET_RESULT_FROM_VIPS_ERROR(env, "failed to create operation", res);
-    goto exit;
+  if (token) {
+    watches = g_new0(VixCancelWatch, plan->n_args);
+
+    if (!watch_input_images(op, plan, token, watches)) {
+      SET_RESULT_FROM_VIPS_ERROR(env, "operation cancel watch", res);
+      goto free_and_exit;
+    }
   }
 
-  res = set_operation_properties(env, op, argv[1]);
-  if (!res.is_success)
+  if (token && cancel_token_is_cancelled(token)) {
+    res.is_success = false;
+    res.result = make_atom(env, "cancelled");
     goto free_and_exit;
+  }
 
   if (!(new_op = vips_cache_operation_build(op))) {
-    SET_RESULT_FROM_VIPS_ERROR(env, "operation build", res);
+    if (token && cancel_token_is_cancelled(token)) {
+      vips_error_clear();
+      res.is_success = false;
+      res.result = make_atom(env, "cancelled");
+    } else {
+      SET_RESULT_FROM_VIPS_ERROR(env, "operation build", res);
+    }
     goto free_and_exit;
   }
 
   g_object_unref(op);
   op = new_op;
 
-  res = get_operation_properties(env, op);
-  if (!res.is_success)
-    goto free_and_exit;
+  res = get_operation_properties(env, op, plan);
 
 free_and_exit:
   // Always unref all used objects, since we are explicitly getting
@@ -256,6 +479,50 @@ free_and_exit:
   vips_object_unref_outputs(VIPS_OBJECT(op));
   g_object_unref(op);
 
+  if (watches) {
+    for (i = 0; i < plan->n_args; i++)
+      cancel_unwatch_image(&watches[i]);
+    g_free(watches);
+  }
+
+  record_operation_stats(plan, start, res.is_success);
+
+  return res;
+}
+
+ERL_NIF_TERM nif_vips_operation_call(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  VixResult res;
+  VixOperationPlan *plan;
+  VixCancelToken *token = NULL;
+  ErlNifTime start;
+  char op_name[200] = {0};
+
+  if (argc != 2 && argc != 3) {
+    error("number of arguments must be 2 or 3");
+    return enif_make_badarg(env);
+  }
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!get_binary(env, argv[0], op_name, 200)) {
+    SET_ERROR_RESULT(env, "operation name must be a valid string", res);
+    goto exit;
+  }
+
+  if (argc == 3 && !get_cancel_token(env, argv[2], &token)) {
+    SET_ERROR_RESULT(env, "failed to get cancel token", res);
+    goto exit;
+  }
+
+  plan = get_operation_plan(op_name);
+  if (!plan) {
+    SET_RESULT_FROM_VIPS_ERROR(env, "failed to create operation", res);
+    goto exit;
+  }
+
+  res = call_operation(env, plan, argv[1], token);
+
 exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   if (res.is_success)
@@ -264,72 +531,329 @@ exit:
     return enif_make_tuple2(env, ATOM_ERROR, res.result);
 }
 
-ERL_NIF_TERM nif_vips_operation_get_arguments(ErlNifEnv *env, int argc,
-                                              const ERL_NIF_TERM argv[]) {
+/* Async calls run on a dedicated pool of native threads instead of a
+ * dirty scheduler. Arguments are copied to a process independent env
+ * which also carries the result back to the caller, copying the terms
+ * keeps the argument resources alive until the job finishes */
+typedef struct _VixOperationJob {
+  ErlNifEnv *env;
+  ErlNifPid pid;
+  ERL_NIF_TERM ref;
+  ERL_NIF_TERM args;
+  VixOperationPlan *plan;
+} VixOperationJob;
+
+static GThreadPool *operation_pool;
+static guint operation_pool_queue_depth;
+
+static void run_operation_job(gpointer data, gpointer user_data) {
+  VixOperationJob *job = (VixOperationJob *)data;
+  ErlNifEnv *env = job->env;
+  ERL_NIF_TERM result;
+  VixResult res;
 
-  ASSERT_ARGC(argc, 1);
+  res = call_operation(env, job->plan, job->args, NULL);
 
-  VipsOperation *op;
+  if (res.is_success)
+    result = make_ok(env, res.result);
+  else
+    result = enif_make_tuple2(env, ATOM_ERROR, res.result);
+
+  if (!enif_send(NULL, &job->pid, env,
+                 enif_make_tuple2(env, job->ref, result))) {
+    debug("operation caller is not alive");
+  }
+
+  // the job runs outside of a NIF, see vix.c
+  g_object_release_call_refs();
+
+  enif_free_env(env);
+  g_free(job);
+}
+
+ERL_NIF_TERM nif_vips_operation_call_async(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 2);
+
+  VixOperationPlan *plan;
+  VixOperationJob *job;
   char op_name[200] = {0};
-  const char **names;
-  int *flags;
-  int n_args = 0;
-  ERL_NIF_TERM list, erl_flags, name, priority, tup, description, result;
+  ERL_NIF_TERM ref, ret;
+  GError *err = NULL;
+
+  if (!get_binary(env, argv[0], op_name, 200)) {
+    ret = make_error(env, "operation name must be a valid string");
+    goto exit;
+  }
+
+  plan = get_operation_plan(op_name);
+  if (!plan) {
+    error("Failed to create operation. error: %s", vips_error_buffer());
+    vips_error_clear();
+    ret = make_error(env, "Failed to create operation");
+    goto exit;
+  }
+
+  if (operation_pool_queue_depth > 0 &&
+      g_thread_pool_unprocessed(operation_pool) >= operation_pool_queue_depth) {
+    ret = make_error_term(env, make_atom(env, "queue_full"));
+    goto exit;
+  }
+
+  ref = enif_make_ref(env);
+
+  job = g_new(VixOperationJob, 1);
+  job->env = enif_alloc_env();
+  job->ref = enif_make_copy(job->env, ref);
+  job->args = enif_make_copy(job->env, argv[1]);
+  job->plan = plan;
+  enif_self(env, &job->pid);
+
+  if (!g_thread_pool_push(operation_pool, job, &err)) {
+    error("Failed to queue operation. error: %s", err->message);
+    g_error_free(err);
+    enif_free_env(job->env);
+    g_free(job);
+    ret = make_error(env, "Failed to queue operation");
+    goto exit;
+  }
+
+  ret = make_ok(env, ref);
+
+exit:
+  return ret;
+}
+
+static VixResult get_node_output(ErlNifEnv *env, VipsOperation **nodes,
+                                 guint n_nodes, ERL_NIF_TERM term) {
+  VixResult res;
+  const ERL_NIF_TERM *tup;
+  int count;
+  guint index;
+  char name[1024];
   GParamSpec *pspec;
   VipsArgumentClass *arg_class;
   VipsArgumentInstance *arg_instance;
-  ErlNifTime start;
 
-  start = enif_monotonic_time(ERL_NIF_USEC);
+  if (!enif_get_tuple(env, term, &count, &tup) || count != 2) {
+    SET_ERROR_RESULT(env, "output must be a tuple of node index and name", res);
+    return res;
+  }
 
-  if (!get_binary(env, argv[0], op_name, 200)) {
-    result = raise_badarg(env, "operation name must be a valid string");
-    goto exit;
+  if (!enif_get_uint(env, tup[0], &index) || index >= n_nodes) {
+    SET_ERROR_RESULT(env, "output node index out of range", res);
+    return res;
   }
 
-  op = vips_operation_new(op_name);
-  if (!op) {
-    ERL_NIF_TERM reason = make_binary(env, "failed to create operation");
+  if (!get_binary(env, tup[1], name, 1024)) {
+    SET_ERROR_RESULT(env, "failed to get output name", res);
+    return res;
+  }
+
+  if (vips_object_get_argument(VIPS_OBJECT(nodes[index]), name, &pspec,
+                               &arg_class, &arg_instance) ||
+      !(arg_class->flags & VIPS_ARGUMENT_OUTPUT)) {
     vips_error_clear();
-    result = enif_raise_exception(env, reason);
+    SET_ERROR_RESULT(env, "node output does not exist", res);
+    return res;
+  }
+
+  return get_erl_term_from_g_object_property(env, G_OBJECT(nodes[index]), name,
+                                             pspec);
+}
+
+/* Builds every node of the pipeline in order and returns only the
+ * requested outputs. Intermediate outputs never leave the NIF, so they
+ * do not need a resource or a janitor round trip. Nodes go through
+ * the operation cache like a regular call */
+ERL_NIF_TERM nif_vips_pipeline_run(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]) {
+  VixResult res;
+  VixOperationPlan *plan;
+  VipsOperation **nodes = NULL;
+  VipsOperation *op, *new_op;
+  ERL_NIF_TERM *outputs = NULL;
+  ERL_NIF_TERM list, head;
+  const ERL_NIF_TERM *tup;
+  int count;
+  guint n_nodes = 0, n_built = 0, n_outputs = 0;
+  char op_name[200] = {0};
+  ErlNifTime start, node_start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  ASSERT_ARGC(argc, 2);
+
+  if (!enif_get_list_length(env, argv[0], &n_nodes) || n_nodes == 0) {
+    SET_ERROR_RESULT(env, "pipeline must have at least one node", res);
     goto exit;
   }
 
-  if (get_vips_operation_args(op, &names, &flags, &n_args) != 0) {
-    error("failed to get VipsObject arguments. error: %s", vips_error_buffer());
-    vips_error_clear();
-    result = raise_exception(env, "failed to get VipsObject arguments");
-    goto free_and_exit;
+  if (!enif_get_list_length(env, argv[1], &n_outputs)) {
+    SET_ERROR_RESULT(env, "outputs must be a list", res);
+    goto exit;
   }
 
-  description = make_binary(env, vips_object_get_description(VIPS_OBJECT(op)));
+  nodes = g_new0(VipsOperation *, n_nodes);
+  list = argv[0];
 
-  list = enif_make_list(env, 0);
+  for (n_built = 0; n_built < n_nodes; n_built++) {
+    if (!enif_get_list_cell(env, list, &head, &list) ||
+        !enif_get_tuple(env, head, &count, &tup) || count != 2) {
+      SET_ERROR_RESULT(env, "node must be a tuple of name and arguments", res);
+      goto free_and_exit;
+    }
 
-  for (int i = 0; i < n_args; i++) {
-    name = make_binary(env, names[i]);
-    erl_flags = vips_argument_flags_to_erl_terms(env, flags[i]);
+    if (!get_binary(env, tup[0], op_name, 200)) {
+      SET_ERROR_RESULT(env, "operation name must be a valid string", res);
+      goto free_and_exit;
+    }
 
-    if (vips_object_get_argument(VIPS_OBJECT(op), names[i], &pspec, &arg_class,
-                                 &arg_instance)) {
-      error("failed to get VipsObject argument. error: %s",
-            vips_error_buffer());
-      vips_error_clear();
-      result = raise_exception(env, "failed to get VipsObject argument");
+    plan = get_operation_plan(op_name);
+    if (!plan) {
+      SET_RESULT_FROM_VIPS_ERROR(env, "failed to create operation", res);
       goto free_and_exit;
     }
 
-    priority = enif_make_int(env, arg_class->priority);
-    tup = enif_make_tuple4(env, name, g_param_spec_details(env, pspec),
-                           priority, erl_flags);
-    list = enif_make_list_cell(env, tup, list);
+    node_start = enif_monotonic_time(ERL_NIF_USEC);
+    op = new_operation_from_plan(plan);
+
+    res = set_operation_properties(env, op, plan, tup[1], nodes, n_built);
+    if (!res.is_success) {
+      vips_object_unref_outputs(VIPS_OBJECT(op));
+      g_object_unref(op);
+      goto free_and_exit;
+    }
+
+    if (!(new_op = vips_cache_operation_build(op))) {
+      SET_RESULT_FROM_VIPS_ERROR(env, "operation build", res);
+      record_operation_stats(plan, node_start, false);
+      vips_object_unref_outputs(VIPS_OBJECT(op));
+      g_object_unref(op);
+      goto free_and_exit;
+    }
+
+    record_operation_stats(plan, node_start, true);
+    g_object_unref(op);
+    nodes[n_built] = new_op;
   }
 
-  result = enif_make_tuple2(env, description, list);
+  outputs = g_new(ERL_NIF_TERM, n_outputs);
+  list = argv[1];
+
+  for (guint i = 0; i < n_outputs; i++) {
+    if (!enif_get_list_cell(env, list, &head, &list)) {
+      SET_ERROR_RESULT(env, "failed to get output list entry", res);
+      goto free_and_exit;
+    }
+
+    res = get_node_output(env, nodes, n_nodes, head);
+    if (!res.is_success)
+      goto free_and_exit;
+
+    outputs[i] = res.result;
+  }
+
+  SET_VIX_RESULT(res, enif_make_list_from_array(env, outputs, n_outputs));
 
 free_and_exit:
-  vips_object_unref_outputs(VIPS_OBJECT(op));
-  g_object_unref(op);
+  for (guint i = 0; i < n_built; i++) {
+    vips_object_unref_outputs(VIPS_OBJECT(nodes[i]));
+    g_object_unref(nodes[i]);
+  }
+
+  g_free(nodes);
+  g_free(outputs);
+
+exit:
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  if (res.is_success)
+    return make_ok(env, res.result);
+  else
+    return enif_make_tuple2(env, ATOM_ERROR, res.result);
+}
+
+ERL_NIF_TERM nif_vips_operation_stats(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]) {
+  ASSERT_ARGC(argc, 0);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  VixOperationPlan *plan;
+  ERL_NIF_TERM list;
+
+  list = enif_make_list(env, 0);
+
+  enif_rwlock_rlock(operation_plans_lock);
+  g_hash_table_iter_init(&iter, operation_plans);
+
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    plan = (VixOperationPlan *)value;
+
+    // plans are also created by introspection, skip unused ones
+    if (atomic_load_explicit(&plan->stats.calls, memory_order_relaxed) == 0)
+      continue;
+
+    list = enif_make_list_cell(
+        env, operation_stats_to_term(env, (const char *)key, &plan->stats),
+        list);
+  }
+
+  enif_rwlock_runlock(operation_plans_lock);
+
+  return list;
+}
+
+static ERL_NIF_TERM operation_arguments_to_term(ErlNifEnv *env,
+                                                VixOperationPlan *plan) {
+  ERL_NIF_TERM list, erl_flags, name, priority, tup, description;
+  GParamSpec *pspec;
+
+  description = make_binary(env, plan->description);
+
+  list = enif_make_list(env, 0);
+
+  for (guint i = 0; i < plan->n_args; i++) {
+    pspec = plan->pspecs[i];
+    name = make_binary(env, g_param_spec_get_name(pspec));
+    erl_flags = vips_argument_flags_to_erl_terms(env, plan->flags[i]);
+    priority = enif_make_int(env, plan->priorities[i]);
+
+    tup = enif_make_tuple5(env, enif_make_uint(env, i), name,
+                           g_param_spec_details(env, pspec), priority,
+                           erl_flags);
+    list = enif_make_list_cell(env, tup, list);
+  }
+
+  return enif_make_tuple2(env, description, list);
+}
+
+ERL_NIF_TERM nif_vips_operation_get_arguments(ErlNifEnv *env, int argc,
+                                              const ERL_NIF_TERM argv[]) {
+
+  ASSERT_ARGC(argc, 1);
+
+  VixOperationPlan *plan;
+  char op_name[200] = {0};
+  ERL_NIF_TERM result;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  if (!get_binary(env, argv[0], op_name, 200)) {
+    result = raise_badarg(env, "operation name must be a valid string");
+    goto exit;
+  }
+
+  plan = get_operation_plan(op_name);
+  if (!plan) {
+    ERL_NIF_TERM reason = make_binary(env, "failed to create operation");
+    vips_error_clear();
+    result = enif_raise_exception(env, reason);
+    goto exit;
+  }
+
+  result = operation_arguments_to_term(env, plan);
 
 exit:
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
@@ -361,53 +885,60 @@ skip:
   return (NULL);
 }
 
-ERL_NIF_TERM nif_vips_operation_list(ErlNifEnv *env, int argc,
-                                     const ERL_NIF_TERM argv[]) {
-
-  ASSERT_ARGC(argc, 0);
-
-  GType type;
+/* Calls `fun` with the type of every non-deprecated concrete operation */
+static void map_operation_types(void (*fun)(GType type, void *data),
+                                void *data) {
   GTypeList type_list;
-  ERL_NIF_TERM list, name;
-  ErlNifTime start;
-
-  start = enif_monotonic_time(ERL_NIF_USEC);
 
   type_list.types = g_new(GType, 1024);
   type_list.count = 0;
 
   vips_type_map_all(VIPS_TYPE_OPERATION, collect_operation_types, &type_list);
 
-  list = enif_make_list(env, 0);
-
-  for (guint i = 0; i < type_list.count; i++) {
-    type = type_list.types[i];
-    name = make_binary(env, vips_nickname_find(type));
-    list = enif_make_list_cell(env, name, list);
-  }
+  for (guint i = 0; i < type_list.count; i++)
+    fun(type_list.types[i], data);
 
   g_free(type_list.types);
+}
 
-  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
-  return list;
+typedef struct _VixTermList {
+  ErlNifEnv *env;
+  ERL_NIF_TERM list;
+} VixTermList;
+
+static void add_operation_name(GType type, void *data) {
+  VixTermList *acc = (VixTermList *)data;
+  ERL_NIF_TERM name = make_binary(acc->env, vips_nickname_find(type));
+  acc->list = enif_make_list_cell(acc->env, name, acc->list);
 }
 
-ERL_NIF_TERM nif_vips_enum_list(ErlNifEnv *env, int argc,
-                                const ERL_NIF_TERM argv[]) {
+ERL_NIF_TERM nif_vips_operation_list(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
 
   ASSERT_ARGC(argc, 0);
 
+  VixTermList acc;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  acc.env = env;
+  acc.list = enif_make_list(env, 0);
+  map_operation_types(add_operation_name, &acc);
+
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return acc.list;
+}
+
+static ERL_NIF_TERM enum_list_term(ErlNifEnv *env) {
   GType type;
   GType *types;
   gpointer g_class;
   GEnumClass *enum_class;
   ERL_NIF_TERM enum_values, tuple, enum_atom, enum_int, enums, name;
   guint count = 0;
-  ErlNifTime start;
   const char *nick;
 
-  start = enif_monotonic_time(ERL_NIF_USEC);
-
   types = g_type_children(G_TYPE_ENUM, &count);
   enums = enif_make_list(env, 0);
 
@@ -440,26 +971,33 @@ ERL_NIF_TERM nif_vips_enum_list(ErlNifEnv *env, int argc,
 
   g_free(types);
 
-  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   return enums;
 }
 
-ERL_NIF_TERM nif_vips_flag_list(ErlNifEnv *env, int argc,
+ERL_NIF_TERM nif_vips_enum_list(ErlNifEnv *env, int argc,
                                 const ERL_NIF_TERM argv[]) {
 
   ASSERT_ARGC(argc, 0);
 
+  ERL_NIF_TERM enums;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+  enums = enum_list_term(env);
+
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return enums;
+}
+
+static ERL_NIF_TERM flag_list_term(ErlNifEnv *env) {
   GType type;
   GType *types;
   gpointer g_class;
   GFlagsClass *flag_class;
   ERL_NIF_TERM flag_values, tuple, flag_atom, flag_int, flags, name;
   guint count = 0;
-  ErlNifTime start;
   const char *nick;
 
-  start = enif_monotonic_time(ERL_NIF_USEC);
-
   types = g_type_children(G_TYPE_FLAGS, &count);
   flags = enif_make_list(env, 0);
 
@@ -492,10 +1030,67 @@ ERL_NIF_TERM nif_vips_flag_list(ErlNifEnv *env, int argc,
 
   g_free(types);
 
+  return flags;
+}
+
+ERL_NIF_TERM nif_vips_flag_list(ErlNifEnv *env, int argc,
+                                const ERL_NIF_TERM argv[]) {
+
+  ASSERT_ARGC(argc, 0);
+
+  ERL_NIF_TERM flags;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+  flags = flag_list_term(env);
+
   notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
   return flags;
 }
 
+static void add_operation_spec(GType type, void *data) {
+  VixTermList *acc = (VixTermList *)data;
+  const char *nickname = vips_nickname_find(type);
+  VixOperationPlan *plan;
+  ERL_NIF_TERM spec;
+
+  plan = get_operation_plan(nickname);
+
+  if (!plan) {
+    error("failed to get operation arguments. error: %s", vips_error_buffer());
+    vips_error_clear();
+    return;
+  }
+
+  spec = enif_make_tuple2(acc->env, make_binary(acc->env, nickname),
+                          operation_arguments_to_term(acc->env, plan));
+  acc->list = enif_make_list_cell(acc->env, spec, acc->list);
+}
+
+/* Everything needed to generate the operation modules in one call:
+ * `{[{name, {description, arguments}}], enums, flags}` */
+ERL_NIF_TERM nif_vips_introspect(ErlNifEnv *env, int argc,
+                                 const ERL_NIF_TERM argv[]) {
+
+  ASSERT_ARGC(argc, 0);
+
+  VixTermList acc;
+  ERL_NIF_TERM result;
+  ErlNifTime start;
+
+  start = enif_monotonic_time(ERL_NIF_USEC);
+
+  acc.env = env;
+  acc.list = enif_make_list(env, 0);
+  map_operation_types(add_operation_spec, &acc);
+
+  result = enif_make_tuple3(env, acc.list, enum_list_term(env),
+                            flag_list_term(env));
+
+  notify_consumed_timeslice(env, start, enif_monotonic_time(ERL_NIF_USEC));
+  return result;
+}
+
 ERL_NIF_TERM nif_vips_cache_set_max(ErlNifEnv *env, int argc,
                                     const ERL_NIF_TERM argv[]) {
   ASSERT_ARGC(argc, 1);
@@ -660,59 +1255,27 @@ exit:
   return ret;
 }
 
-static void *load_operation(GType type, void *a) {
-  const char **names;
-  gpointer g_class;
-  VipsObjectClass *class;
-  VipsOperation *op;
-  int *flags;
-  bool *err;
-  int n_args = 0;
-
-  err = (bool *)a;
-
-  g_class = g_type_class_ref(type);
-  class = VIPS_OBJECT_CLASS(g_class);
-
-  if (class->deprecated)
-    goto unref_class_exit;
-  if (VIPS_IS_OPERATION_CLASS(class) &&
-      (VIPS_OPERATION_CLASS(class)->flags & VIPS_OPERATION_DEPRECATED))
-    goto unref_class_exit;
-  if (G_TYPE_IS_ABSTRACT(type))
-    goto unref_class_exit;
-
-  op = vips_operation_new(vips_nickname_find(type));
-
-  if (op == NULL) {
-    goto unref_class_exit;
-  }
+/* Initializing the class is enough to register argument types and
+ * build the plan, no need to instantiate the operation */
+static void load_operation(GType type, void *a) {
+  bool *err = (bool *)a;
 
-  if (get_vips_operation_args(op, &names, &flags, &n_args) != 0) {
-    error("failed to get VipsObject arguments. error: %s", vips_error_buffer());
+  if (!get_operation_plan(vips_nickname_find(type))) {
+    error("failed to get operation arguments. error: %s", vips_error_buffer());
     vips_error_clear();
     *err = true;
   }
-
-  vips_object_unref_outputs(VIPS_OBJECT(op));
-  g_object_unref(op);
-
-unref_class_exit:
-  g_type_class_unref(g_class);
-
-  if (*err)
-    return err;
-  else
-    return (NULL);
 }
 
 static int load_vips_types(ErlNifEnv *env) {
   bool error = false;
-  vips_type_map_all(VIPS_TYPE_OPERATION, load_operation, &error);
+  map_operation_types(load_operation, &error);
   return error ? 1 : 0;
 }
 
-int nif_vips_operation_init(ErlNifEnv *env) {
+int nif_vips_operation_init(ErlNifEnv *env, int pool_size, int queue_depth) {
+  GError *err = NULL;
+
   ATOM_VIPS_ARGUMENT_NONE = make_atom(env, "vips_argument_none");
   ATOM_VIPS_ARGUMENT_REQUIRED = make_atom(env, "vips_argument_required");
   ATOM_VIPS_ARGUMENT_CONSTRUCT = make_atom(env, "vips_argument_construct");
@@ -723,6 +1286,19 @@ int nif_vips_operation_init(ErlNifEnv *env) {
   ATOM_VIPS_ARGUMENT_DEPRECATED = make_atom(env, "vips_argument_deprecated");
   ATOM_VIPS_ARGUMENT_MODIFY = make_atom(env, "vips_argument_modify");
 
+  operation_plans = g_hash_table_new(g_str_hash, g_str_equal);
+  operation_plans_lock = enif_rwlock_create("vix operation plans");
+
+  operation_pool_queue_depth = (guint)queue_depth;
+  operation_pool =
+      g_thread_pool_new(run_operation_job, NULL, pool_size, TRUE, &err);
+
+  if (!operation_pool) {
+    error("Failed to create operation pool. error: %s", err->message);
+    g_error_free(err);
+    return 1;
+  }
+
   /* There is a race condition; if we attempt to access subclass of a
      class before definitions are "loaded" we won't be able to get any
      entries */
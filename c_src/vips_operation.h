@@ -6,12 +6,24 @@
 ERL_NIF_TERM nif_vips_operation_call(ErlNifEnv *env, int argc,
                                      const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_vips_operation_call_async(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_vips_operation_stats(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]);
+
+ERL_NIF_TERM nif_vips_pipeline_run(ErlNifEnv *env, int argc,
+                                   const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_vips_operation_get_arguments(ErlNifEnv *env, int argc,
                                               const ERL_NIF_TERM argv[]);
 
 ERL_NIF_TERM nif_vips_operation_list(ErlNifEnv *env, int argc,
                                      const ERL_NIF_TERM argv[]);
 
+ERL_NIF_TERM nif_vips_introspect(ErlNifEnv *env, int argc,
+                                 const ERL_NIF_TERM argv[]);
+
 ERL_NIF_TERM nif_vips_enum_list(ErlNifEnv *env, int argc,
                                 const ERL_NIF_TERM argv[]);
 
@@ -60,6 +72,6 @@ ERL_NIF_TERM nif_vips_version(ErlNifEnv *env, int argc,
 ERL_NIF_TERM nif_vips_nickname_find(ErlNifEnv *env, int argc,
                                     const ERL_NIF_TERM argv[]);
 
-int nif_vips_operation_init(ErlNifEnv *env);
+int nif_vips_operation_init(ErlNifEnv *env, int pool_size, int queue_depth);
 
 #endif
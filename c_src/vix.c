@@ -4,11 +4,19 @@
 
 #include "utils.h"
 
+#include "cancel.h"
+#include "fd_target.h"
 #include "g_object/g_boxed.h"
 #include "g_object/g_object.h"
 #include "g_object/g_param_spec.h"
 #include "g_object/g_type.h"
+#include "janitor.h"
+#include "load_index.h"
+#include "parallel.h"
 #include "pipe.h"
+#include "seekable_source.h"
+#include "source_stream.h"
+#include "target_stream.h"
 #include "vips_boxed.h"
 #include "vips_foreign.h"
 #include "vips_image.h"
@@ -35,6 +43,25 @@ static int on_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
     return 1;
   }
 
+  ERL_NIF_TERM pool_size_term, queue_depth_term;
+  int pool_size, queue_depth;
+
+  if (!enif_get_map_value(env, load_info,
+                          enif_make_atom(env, "operation_pool_size"),
+                          &pool_size_term) ||
+      !enif_get_int(env, pool_size_term, &pool_size) || pool_size < 1) {
+    error("Failed to fetch operation pool size from config");
+    return 1;
+  }
+
+  if (!enif_get_map_value(env, load_info,
+                          enif_make_atom(env, "operation_pool_queue_depth"),
+                          &queue_depth_term) ||
+      !enif_get_int(env, queue_depth_term, &queue_depth) || queue_depth < 0) {
+    error("Failed to fetch operation pool queue depth from config");
+    return 1;
+  }
+
 #ifdef DEBUG
   vips_leak_set(true);
   // when checking for leaks disable cache
@@ -44,6 +71,15 @@ static int on_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
   if (utils_init(env, log_level))
     return 1;
 
+  if (nif_janitor_init(env))
+    return 1;
+
+  if (load_index_init())
+    return 1;
+
+  if (nif_foreign_init(env))
+    return 1;
+
   if (nif_g_object_init(env))
     return 1;
 
@@ -56,122 +92,166 @@ static int on_load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
   if (nif_g_type_init(env))
     return 1;
 
-  if (nif_vips_operation_init(env))
+  if (nif_vips_operation_init(env, pool_size, queue_depth))
+    return 1;
+
+  if (parallel_init())
     return 1;
 
   if (nif_pipe_init(env))
     return 1;
 
+  if (nif_cancel_init(env))
+    return 1;
+
+  if (nif_target_stream_init(env))
+    return 1;
+
+  if (nif_source_stream_init(env))
+    return 1;
+
+  if (nif_seekable_source_init(env))
+    return 1;
+
   return 0;
 }
 
-static ErlNifFunc nif_funcs[] = {
-    /* GObject */
-    {"nif_g_object_type_name", 1, nif_g_object_type_name, 0},
-    {"nif_g_object_unref", 1, nif_g_object_unref, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-
-    /* GType */
-    {"nif_g_type_from_instance", 1, nif_g_type_from_instance, 0},
-    {"nif_g_type_name", 1, nif_g_type_name, 0},
-
-    /* VipsInterpolate */
-    {"nif_interpolate_new", 1, nif_interpolate_new, 0},
-
-    /* VipsImage */
-    {"nif_image_new_from_file", 1, nif_image_new_from_file,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_new_from_image", 2, nif_image_new_from_image,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_copy_memory", 1, nif_image_copy_memory,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_write_to_file", 2, nif_image_write_to_file,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_write_to_buffer", 2, nif_image_write_to_buffer,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_new", 0, nif_image_new, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_new_temp_file", 1, nif_image_new_temp_file,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_new_matrix_from_array", 5, nif_image_new_matrix_from_array, 0},
-    {"nif_image_get_fields", 1, nif_image_get_fields, 0},
-    {"nif_image_get_header", 2, nif_image_get_header, 0},
-    {"nif_image_get_as_string", 2, nif_image_get_as_string, 0},
-    {"nif_image_hasalpha", 1, nif_image_hasalpha, 0},
-    {"nif_image_new_from_source", 2, nif_image_new_from_source,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_to_target", 3, nif_image_to_target, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_new_from_binary", 5, nif_image_new_from_binary,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_image_write_to_binary", 1, nif_image_write_to_binary,
-     ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_image_write_area_to_binary", 2, nif_image_write_area_to_binary,
-     ERL_NIF_DIRTY_JOB_CPU_BOUND},
-
-    /* VipsImage UNSAFE */
-    {"nif_image_update_metadata", 3, nif_image_update_metadata, 0},
-    {"nif_image_set_metadata", 4, nif_image_set_metadata, 0},
-    {"nif_image_remove_metadata", 2, nif_image_remove_metadata, 0},
-
-    /* VipsOperation */
-    /* should these be ERL_NIF_DIRTY_JOB_IO_BOUND? */
-    {"nif_vips_operation_call", 2, nif_vips_operation_call,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"nif_vips_operation_get_arguments", 1, nif_vips_operation_get_arguments,
-     ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_vips_operation_list", 0, nif_vips_operation_list,
-     ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_vips_enum_list", 0, nif_vips_enum_list, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_vips_flag_list", 0, nif_vips_flag_list, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-
-    /* Vips */
-    {"nif_vips_cache_set_max", 1, nif_vips_cache_set_max, 0},
-    {"nif_vips_cache_get_max", 0, nif_vips_cache_get_max, 0},
-    {"nif_vips_concurrency_set", 1, nif_vips_concurrency_set, 0},
-    {"nif_vips_concurrency_get", 0, nif_vips_concurrency_get, 0},
-    {"nif_vips_cache_set_max_files", 1, nif_vips_cache_set_max_files, 0},
-    {"nif_vips_cache_get_max_files", 0, nif_vips_cache_get_max_files, 0},
-    {"nif_vips_cache_set_max_mem", 1, nif_vips_cache_set_max_mem, 0},
-    {"nif_vips_cache_get_max_mem", 0, nif_vips_cache_get_max_mem, 0},
-    {"nif_vips_leak_set", 1, nif_vips_leak_set, 0},
-    {"nif_vips_tracked_get_mem", 0, nif_vips_tracked_get_mem, 0},
-    {"nif_vips_tracked_get_mem_highwater", 0, nif_vips_tracked_get_mem_highwater, 0},
-    {"nif_vips_version", 0, nif_vips_version, 0},
-    {"nif_vips_shutdown", 0, nif_vips_shutdown, 0},
-    {"nif_vips_nickname_find", 1, nif_vips_nickname_find, 0},
-
-    /* VipsBoxed */
-    {"nif_int_array", 1, nif_int_array, 0},
-    {"nif_image_array", 1, nif_image_array, 0},
-    {"nif_double_array", 1, nif_double_array, 0},
-    {"nif_vips_blob", 1, nif_vips_blob, 0},
-    {"nif_vips_ref_string", 1, nif_vips_ref_string, 0},
-    {"nif_vips_int_array_to_erl_list", 1, nif_vips_int_array_to_erl_list, 0},
-    {"nif_vips_double_array_to_erl_list", 1, nif_vips_double_array_to_erl_list,
-     0},
-    {"nif_vips_image_array_to_erl_list", 1, nif_vips_image_array_to_erl_list,
-     0},
-    {"nif_vips_blob_to_erl_binary", 1, nif_vips_blob_to_erl_binary, 0},
-    {"nif_vips_ref_string_to_erl_binary", 1, nif_vips_ref_string_to_erl_binary,
-     0},
-    {"nif_g_boxed_unref", 1, nif_g_boxed_unref, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-
-    /* VipsForeign */
-    {"nif_foreign_find_load", 1, nif_foreign_find_load, 0},
-    {"nif_foreign_find_save", 1, nif_foreign_find_save, 0},
-    {"nif_foreign_find_load_buffer", 1, nif_foreign_find_load_buffer,
-     ERL_NIF_DIRTY_JOB_IO_BOUND},
-    // it might read bytes form the file
-    {"nif_foreign_find_save_buffer", 1, nif_foreign_find_save_buffer, 0},
-    {"nif_foreign_find_load_source", 1, nif_foreign_find_load_source,
-     ERL_NIF_DIRTY_JOB_IO_BOUND}, // it might read bytes from source
-    {"nif_foreign_find_save_target", 1, nif_foreign_find_save_target, 0},
-    {"nif_foreign_get_suffixes", 0, nif_foreign_get_suffixes, 0},
-    {"nif_foreign_get_loader_suffixes", 0, nif_foreign_get_loader_suffixes, 0},
-
-    /* Syscalls */
-    {"nif_pipe_open", 1, nif_pipe_open, 0},
-    {"nif_write", 2, nif_write, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_read", 2, nif_read, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_source_new", 0, nif_source_new, ERL_NIF_DIRTY_JOB_CPU_BOUND},
-    {"nif_target_new", 0, nif_target_new, ERL_NIF_DIRTY_JOB_CPU_BOUND}};
+/*
+ * NIFs look up the objects of their arguments with `erl_term_to_g_object`,
+ * which takes a reference owned by the call, so that `Image.release/1`
+ * can drop the reference of the term while other calls still use it.
+ * Every NIF is wrapped to drop those references once it returns.
+ */
+#define VIX_NIFS(NIF)                                                         \
+  /* GObject */                                                               \
+  NIF(nif_g_object_type_name, 1, 0)                                           \
+  NIF(nif_g_object_release, 1, 0)                                             \
+                                                                              \
+  /* GType */                                                                 \
+  NIF(nif_g_type_from_instance, 1, 0)                                         \
+  NIF(nif_g_type_name, 1, 0)                                                  \
+                                                                              \
+  /* VipsInterpolate */                                                       \
+  NIF(nif_interpolate_new, 1, 0)                                              \
+                                                                              \
+  /* VipsImage */                                                             \
+  NIF(nif_image_new_from_file, 1, ERL_NIF_DIRTY_JOB_IO_BOUND)                 \
+  NIF(nif_image_new_from_image, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)                \
+  NIF(nif_image_copy_memory, 1, ERL_NIF_DIRTY_JOB_IO_BOUND)                   \
+  NIF(nif_image_copy_memory_private, 1, ERL_NIF_DIRTY_JOB_CPU_BOUND)          \
+  NIF(nif_image_write_to_file, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)                 \
+  NIF(nif_image_write_to_buffer, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)               \
+  NIF(nif_image_new, 0, ERL_NIF_DIRTY_JOB_IO_BOUND)                           \
+  NIF(nif_image_new_temp_file, 1, ERL_NIF_DIRTY_JOB_IO_BOUND)                 \
+  NIF(nif_image_new_matrix_from_array, 5, 0)                                  \
+  NIF(nif_image_new_matrix_from_binary, 5, 0)                                 \
+  NIF(nif_image_get_fields, 1, 0)                                             \
+  NIF(nif_image_get_header, 2, 0)                                             \
+  NIF(nif_image_get_headers, 2, 0)                                            \
+  NIF(nif_image_get_as_string, 2, 0)                                          \
+  NIF(nif_image_hasalpha, 1, 0)                                               \
+  NIF(nif_image_new_from_source, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)               \
+  NIF(nif_image_to_target, 3, ERL_NIF_DIRTY_JOB_IO_BOUND)                     \
+  NIF(nif_image_new_from_binary, 5, ERL_NIF_DIRTY_JOB_IO_BOUND)               \
+  NIF(nif_image_write_to_binary, 1, ERL_NIF_DIRTY_JOB_CPU_BOUND)              \
+  NIF(nif_image_write_area_to_binary, 2, ERL_NIF_DIRTY_JOB_CPU_BOUND)         \
+  NIF(nif_image_write_areas_to_binary, 3, ERL_NIF_DIRTY_JOB_CPU_BOUND)        \
+  NIF(nif_image_write_batch_to_binary, 5, ERL_NIF_DIRTY_JOB_CPU_BOUND)        \
+                                                                              \
+  /* VipsImage UNSAFE */                                                      \
+  NIF(nif_image_update_metadata, 3, 0)                                        \
+  NIF(nif_image_set_metadata, 4, 0)                                           \
+  NIF(nif_image_remove_metadata, 2, 0)                                        \
+                                                                              \
+  /* VipsOperation */                                                         \
+  /* should these be ERL_NIF_DIRTY_JOB_IO_BOUND? */                           \
+  NIF(nif_vips_operation_call, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)                 \
+  NIF(nif_vips_operation_call, 3, ERL_NIF_DIRTY_JOB_IO_BOUND)                 \
+  NIF(nif_vips_operation_call_async, 2, 0)                                    \
+  NIF(nif_vips_pipeline_run, 2, ERL_NIF_DIRTY_JOB_IO_BOUND)                   \
+  NIF(nif_vips_operation_get_arguments, 1, ERL_NIF_DIRTY_JOB_CPU_BOUND)       \
+  NIF(nif_vips_operation_list, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                \
+  NIF(nif_vips_introspect, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                    \
+  NIF(nif_vips_enum_list, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                     \
+  NIF(nif_vips_flag_list, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                     \
+  NIF(nif_vips_operation_stats, 0, 0)                                         \
+  NIF(nif_cancel_token_new, 2, 0)                                             \
+                                                                              \
+  /* Vips */                                                                  \
+  NIF(nif_vips_cache_set_max, 1, 0)                                           \
+  NIF(nif_vips_cache_get_max, 0, 0)                                           \
+  NIF(nif_vips_concurrency_set, 1, 0)                                         \
+  NIF(nif_vips_concurrency_get, 0, 0)                                         \
+  NIF(nif_vips_cache_set_max_files, 1, 0)                                     \
+  NIF(nif_vips_cache_get_max_files, 0, 0)                                     \
+  NIF(nif_vips_cache_set_max_mem, 1, 0)                                       \
+  NIF(nif_vips_cache_get_max_mem, 0, 0)                                       \
+  NIF(nif_vips_leak_set, 1, 0)                                                \
+  NIF(nif_vips_tracked_get_mem, 0, 0)                                         \
+  NIF(nif_vips_tracked_get_mem_highwater, 0, 0)                               \
+  NIF(nif_vips_version, 0, 0)                                                 \
+  NIF(nif_vips_shutdown, 0, 0)                                                \
+  NIF(nif_vips_nickname_find, 1, 0)                                           \
+                                                                              \
+  /* VipsBoxed */                                                             \
+  NIF(nif_int_array, 1, 0)                                                    \
+  NIF(nif_image_array, 1, 0)                                                  \
+  NIF(nif_double_array, 1, 0)                                                 \
+  NIF(nif_int_array_from_binary, 1, 0)                                        \
+  NIF(nif_double_array_from_binary, 1, 0)                                     \
+  NIF(nif_vips_blob, 1, 0)                                                    \
+  NIF(nif_vips_ref_string, 1, 0)                                              \
+  NIF(nif_vips_int_array_to_erl_list, 1, 0)                                   \
+  NIF(nif_vips_double_array_to_erl_list, 1, 0)                                \
+  NIF(nif_vips_int_array_to_binary, 1, 0)                                     \
+  NIF(nif_vips_double_array_to_binary, 1, 0)                                  \
+  NIF(nif_vips_image_array_to_erl_list, 1, 0)                                 \
+  NIF(nif_vips_blob_to_erl_binary, 1, 0)                                      \
+  NIF(nif_vips_ref_string_to_erl_binary, 1, 0)                                \
+                                                                              \
+  /* VipsForeign */                                                           \
+  NIF(nif_foreign_find_load, 1, 0)                                            \
+  NIF(nif_foreign_find_save, 1, 0)                                            \
+  NIF(nif_foreign_find_load_buffer, 1, ERL_NIF_DIRTY_JOB_IO_BOUND)            \
+  /* it might read bytes form the file */                                     \
+  NIF(nif_foreign_find_save_buffer, 1, 0)                                     \
+  /* it might read bytes from source */                                       \
+  NIF(nif_foreign_find_load_source, 1, ERL_NIF_DIRTY_JOB_IO_BOUND)            \
+  NIF(nif_foreign_find_save_target, 1, 0)                                     \
+  NIF(nif_foreign_get_suffixes, 0, 0)                                         \
+  NIF(nif_foreign_get_loader_suffixes, 0, 0)                                  \
+  NIF(nif_foreign_get_savers, 0, 0)                                           \
+                                                                              \
+  /* Syscalls */                                                              \
+  NIF(nif_pipe_open, 1, 0)                                                    \
+  NIF(nif_write, 2, ERL_NIF_DIRTY_JOB_CPU_BOUND)                              \
+  NIF(nif_read, 2, ERL_NIF_DIRTY_JOB_CPU_BOUND)                               \
+  NIF(nif_source_new, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                         \
+  NIF(nif_target_new, 0, ERL_NIF_DIRTY_JOB_CPU_BOUND)                         \
+  NIF(nif_target_stream_new, 1, 0)                                            \
+  NIF(nif_target_stream_credit, 2, 0)                                         \
+  NIF(nif_target_stream_close, 1, 0)                                          \
+  NIF(nif_source_stream_new, 1, 0)                                            \
+  NIF(nif_source_stream_write, 2, 0)                                          \
+  NIF(nif_source_stream_finish, 1, 0)                                         \
+  NIF(nif_source_stream_close, 1, 0)                                          \
+  NIF(nif_seekable_source_new, 1, 0)                                          \
+  NIF(nif_seekable_source_reply, 3, 0)                                        \
+  NIF(nif_fd_target_new, 2, 0)                                                \
+  NIF(nif_janitor_queue_depth, 0, 0)
+
+#define VIX_NIF_WRAPPER(fn, arity, flags)                                     \
+  static ERL_NIF_TERM fn##_##arity##_call(ErlNifEnv *env, int argc,           \
+                                          const ERL_NIF_TERM argv[]) {        \
+    ERL_NIF_TERM ret = fn(env, argc, argv);                                   \
+    g_object_release_call_refs();                                             \
+    return ret;                                                               \
+  }
+
+VIX_NIFS(VIX_NIF_WRAPPER)
+
+#define VIX_NIF_FUNC(fn, arity, flags) {#fn, arity, fn##_##arity##_call, flags},
+
+static ErlNifFunc nif_funcs[] = {VIX_NIFS(VIX_NIF_FUNC)};
 
 ERL_NIF_INIT(Elixir.Vix.Nif, nif_funcs, &on_load, NULL, NULL, NULL)
@@ -2,12 +2,13 @@ defmodule Vix.GObject.GParamSpec do
   @moduledoc false
   @type t :: %{}
 
-  defstruct [:param_name, :desc, :spec_type, :value_type, :data, :priority, :flags, :type]
+  defstruct [:id, :param_name, :desc, :spec_type, :value_type, :data, :priority, :flags, :type]
 
   alias __MODULE__
 
   def new(opt) do
     pspec = %GParamSpec{
+      id: opt.id,
       param_name: opt.name,
       desc: opt.desc,
       spec_type: to_string(opt.spec_type),
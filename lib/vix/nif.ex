@@ -2,63 +2,7 @@ defmodule Vix.Nif do
   @moduledoc false
   @on_load :load_nifs
 
-  defmodule Janitor do
-    @moduledoc false
-    use GenServer
-
-    # Because Vix needs to run NIFs at compile-time and the `@on_load`
-    # callback uses the Janitor, let's ensure the Janitor is explicitly
-    # loaded after compilation, otherwise the Janitor may not be found
-    # from within the `@on_load` callback.
-    @compile {:autoload, true}
-
-    # Singleton process to safely cleanup native resources
-    alias __MODULE__
-
-    def start do
-      GenServer.start(Janitor, nil, name: Janitor)
-    end
-
-    ## Callbacks
-
-    @impl true
-    def init(nil) do
-      {:ok, nil}
-    end
-
-    @allowd_types [:unref_gobject, :unref_gboxed]
-
-    @impl true
-    def handle_info({type, term}, nil) when type in @allowd_types do
-      # Use a dedicated process to prevent blocking the Janitor
-      # singleton process. The task process is not linked to the
-      # parent to ensure that errors do not cause the Janitor to
-      # crash.
-      _ = Task.start(Janitor, :unref, [type, term])
-      {:noreply, nil}
-    end
-
-    @doc false
-    @spec unref(atom, reference()) :: :ok
-    def unref(type, term) do
-      case type do
-        :unref_gboxed ->
-          :ok = Vix.Nif.nif_g_boxed_unref(term)
-
-        :unref_gobject ->
-          :ok = Vix.Nif.nif_g_object_unref(term)
-      end
-    end
-  end
-
   def load_nifs do
-    # must be started outside the supervision tree since the process
-    # that calls `load_nifs` will exit eventually.
-    case Vix.Nif.Janitor.start() do
-      {:ok, _pid} -> :ok
-      {:error, {:already_started, _pid}} -> :ok
-    end
-
     nif_path = :filename.join(:code.priv_dir(:vix), "vix")
     :erlang.load_nif(nif_path, load_config())
   end
@@ -67,7 +11,7 @@ defmodule Vix.Nif do
   def nif_g_object_type_name(_obj),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
-  def nif_g_object_unref(_obj),
+  def nif_g_object_release(_obj),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
   # GType
@@ -91,6 +35,9 @@ defmodule Vix.Nif do
   def nif_image_copy_memory(_vips_image),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_image_copy_memory_private(_vips_image),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_image_write_to_file(_vips_image, _dst),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
@@ -106,12 +53,18 @@ defmodule Vix.Nif do
   def nif_image_new_matrix_from_array(_height, _width, _list, _scale, _offset),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_image_new_matrix_from_binary(_width, _height, _binary, _scale, _offset),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_image_get_fields(_vips_image),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
   def nif_image_get_header(_vips_image, _name),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_image_get_headers(_vips_image, _names),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_image_get_as_string(_vips_image, _name),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
@@ -133,6 +86,12 @@ defmodule Vix.Nif do
   def nif_image_write_area_to_binary(_vips_image, _params_list),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_image_write_areas_to_binary(_vips_image, _areas, _contiguous),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_image_write_batch_to_binary(_vips_images, _channels_first, _band_format, _mean, _std),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   # VipsImage *UNSAFE*
   def nif_image_update_metadata(_vips_image, _name, _value),
     do: :erlang.nif_error(:nif_library_not_loaded)
@@ -147,12 +106,30 @@ defmodule Vix.Nif do
   def nif_vips_operation_call(_vips_operation_name, _input),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_vips_operation_call(_vips_operation_name, _input, _cancel_token),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_vips_operation_call_async(_vips_operation_name, _input),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_vips_pipeline_run(_nodes, _outputs),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_vips_operation_stats,
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_cancel_token_new(_owner, _timeout),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_vips_operation_get_arguments(_operation_name),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
   def nif_vips_operation_list,
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_vips_introspect,
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_vips_enum_list,
     do: :erlang.nif_error(:nif_library_not_loaded)
 
@@ -211,6 +188,12 @@ defmodule Vix.Nif do
   def nif_double_array(_double_list),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_int_array_from_binary(_binary),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_double_array_from_binary(_binary),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_vips_blob(_binary),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
@@ -223,6 +206,12 @@ defmodule Vix.Nif do
   def nif_vips_double_array_to_erl_list(_vips_double_array),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_vips_int_array_to_binary(_vips_int_array),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_vips_double_array_to_binary(_vips_double_array),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   def nif_vips_image_array_to_erl_list(_vips_image_array),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
@@ -232,9 +221,6 @@ defmodule Vix.Nif do
   def nif_vips_ref_string_to_erl_binary(_vips_blob),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
-  def nif_g_boxed_unref(_obj),
-    do: :erlang.nif_error(:nif_library_not_loaded)
-
   # VipsForeign
   def nif_foreign_find_load_buffer(_binary),
     do: :erlang.nif_error(:nif_library_not_loaded)
@@ -260,11 +246,14 @@ defmodule Vix.Nif do
   def nif_foreign_get_loader_suffixes,
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_foreign_get_savers,
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   # OS Specific
   def nif_pipe_open(_mode),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
-  def nif_write(_fd, _bin),
+  def nif_write(_fd, _iodata),
     do: :erlang.nif_error(:nif_library_not_loaded)
 
   def nif_read(_fd, _max_size),
@@ -276,9 +265,68 @@ defmodule Vix.Nif do
   def nif_target_new,
     do: :erlang.nif_error(:nif_library_not_loaded)
 
+  def nif_target_stream_new(_credits),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_target_stream_credit(_stream, _credits),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_target_stream_close(_stream),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_source_stream_new(_max_queued_bytes),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_source_stream_write(_stream, _iovec),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_source_stream_finish(_stream),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_source_stream_close(_stream),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_seekable_source_new(_size),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_seekable_source_reply(_stream, _request_id, _data),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_fd_target_new(_fd, _timeout),
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
+  def nif_janitor_queue_depth,
+    do: :erlang.nif_error(:nif_library_not_loaded)
+
   @spec load_config :: map
   defp load_config do
-    %{nif_logger_level: nif_logger_level()}
+    %{
+      nif_logger_level: nif_logger_level(),
+      operation_pool_size: operation_pool_size(),
+      operation_pool_queue_depth: operation_pool_queue_depth()
+    }
+  end
+
+  @spec operation_pool_size :: pos_integer
+  defp operation_pool_size do
+    case Application.get_env(:vix, :operation_pool_size) do
+      size when is_integer(size) and size > 0 ->
+        size
+
+      _ ->
+        System.schedulers_online()
+    end
+  end
+
+  @spec operation_pool_queue_depth :: non_neg_integer
+  defp operation_pool_queue_depth do
+    case Application.get_env(:vix, :operation_pool_queue_depth) do
+      depth when is_integer(depth) and depth >= 0 ->
+        depth
+
+      _ ->
+        1024
+    end
   end
 
   @spec nif_logger_level :: :error | :warning | :none
@@ -153,6 +153,37 @@ defmodule Vix.Operator do
     max == +0.0
   end
 
+  @doc """
+  Evaluates the operators in `expression` as fused libvips operations.
+
+  Each operator normally calls an operation right away, so
+  `(img * 1.2 + 10) > 128` makes three native calls and allocates
+  three images. Within `fuse/1` the operators build an expression
+  tree instead, which is simplified and then evaluated in a single
+  native call using `Vix.Vips.Pipeline`. Consecutive arithmetic with
+  numbers or lists of numbers folds into a single `linear` operation,
+  so the example above runs as a `linear` and a `relational_const`.
+
+  ```elixir
+  require Vix.Operator
+
+  mask = Vix.Operator.fuse((img * 1.2 + 10) > 128)
+  ```
+
+  Operators behave the same as the eager ones, and fall back to
+  `Kernel` when no image is involved. Since folded constants are
+  combined in double precision, results can differ from the eager
+  operators in the last bits of float images.
+
+  The operators are rewritten syntactically, whether they are imported
+  from `Vix.Operator` or not. `expression` must not contain operators
+  in patterns or guards.
+  """
+  @doc since: "0.42.0"
+  defmacro fuse(expression) do
+    Vix.Operator.Fusion.rewrite(expression)
+  end
+
   ### Arithmetic Operators
 
   @basic_arithmetic_format_doc """
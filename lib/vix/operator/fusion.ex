@@ -0,0 +1,187 @@
+defmodule Vix.Operator.Fusion do
+  @moduledoc false
+
+  # Expression trees built by `Vix.Operator.fuse/1`.
+  #
+  # Each operator applied to an image returns a node instead of calling
+  # the operation. Nodes are either
+  #
+  #   * `{:linear, input, a, b}` - `input * a + b`, band-wise
+  #   * `{:call, operation, args}` - any other operation
+  #
+  # where `input` and `args` can be images or nodes. Building a linear
+  # node on top of another one folds them into a single one, so chains
+  # of constant arithmetic become a single `linear`. `eval/1` adds the
+  # remaining nodes to a `Vix.Vips.Pipeline` which is run in one call.
+
+  alias Vix.Vips.Image
+  alias Vix.Vips.Operation
+  alias Vix.Vips.Pipeline
+
+  @operators [:+, :-, :*, :/, :**, :<, :>, :<=, :>=, :==, :!=]
+
+  @relational %{
+    <: {:VIPS_OPERATION_RELATIONAL_LESS, :VIPS_OPERATION_RELATIONAL_MOREEQ},
+    >: {:VIPS_OPERATION_RELATIONAL_MORE, :VIPS_OPERATION_RELATIONAL_LESSEQ},
+    <=: {:VIPS_OPERATION_RELATIONAL_LESSEQ, :VIPS_OPERATION_RELATIONAL_MORE},
+    >=: {:VIPS_OPERATION_RELATIONAL_MOREEQ, :VIPS_OPERATION_RELATIONAL_LESS},
+    ==: {:VIPS_OPERATION_RELATIONAL_EQUAL, :VIPS_OPERATION_RELATIONAL_EQUAL},
+    !=: {:VIPS_OPERATION_RELATIONAL_NOTEQ, :VIPS_OPERATION_RELATIONAL_NOTEQ}
+  }
+
+  @doc false
+  @spec rewrite(Macro.t()) :: Macro.t()
+  def rewrite(ast) do
+    Macro.prewalk(ast, fn
+      {op, _meta, [_, _]} = node when op in @operators ->
+        quote do
+          Vix.Operator.Fusion.eval(unquote(tree(node)))
+        end
+
+      node ->
+        node
+    end)
+  end
+
+  defp tree({op, _meta, [a, b]}) when op in @operators do
+    quote do
+      Vix.Operator.Fusion.op(unquote(op), unquote(tree(a)), unquote(tree(b)))
+    end
+  end
+
+  defp tree(leaf), do: leaf
+
+  @doc false
+  def op(op, a, b) do
+    if node?(a) or node?(b) do
+      node(op, normalize(a), normalize(b))
+    else
+      apply(Kernel, op, [a, b])
+    end
+  end
+
+  @doc false
+  def eval(value) do
+    if node?(value) and not is_struct(value, Image) do
+      {pipeline, ref} = emit(Pipeline.new(), value)
+
+      case Pipeline.run(pipeline, ref) do
+        {:ok, image} -> image
+        {:error, reason} when is_binary(reason) -> raise Operation.Error, message: reason
+        {:error, reason} -> raise Operation.Error, message: inspect(reason)
+      end
+    else
+      value
+    end
+  end
+
+  defp node?(%Image{}), do: true
+  defp node?({:linear, _, _, _}), do: true
+  defp node?({:call, _, _}), do: true
+  defp node?(_), do: false
+
+  defp normalize(value) when is_number(value), do: [value]
+
+  defp normalize(value) when is_list(value) do
+    if not Enum.all?(value, &is_number/1) do
+      raise ArgumentError, "list elements must be a number, got: #{inspect(value)}"
+    end
+
+    value
+  end
+
+  defp normalize(value) do
+    if node?(value), do: value, else: raise(ArgumentError)
+  end
+
+  # same operations as the eager operators in `Vix.Operator`
+
+  defp node(:+, a, b) when is_list(b), do: linear(a, [1.0], b)
+  defp node(:+, a, b) when is_list(a), do: linear(b, [1.0], a)
+  defp node(:+, a, b), do: {:call, :add, [a, b]}
+
+  defp node(:*, a, b) when is_list(b), do: linear(a, b, [+0.0])
+  defp node(:*, a, b) when is_list(a), do: linear(b, a, [+0.0])
+  defp node(:*, a, b), do: {:call, :multiply, [a, b]}
+
+  defp node(:-, a, b) when is_list(b), do: linear(a, [1.0], Enum.map(b, &(-&1)))
+  defp node(:-, a, b) when is_list(a), do: linear(b, [-1.0], a)
+  defp node(:-, a, b), do: {:call, :subtract, [a, b]}
+
+  defp node(:/, a, b) when is_list(b), do: linear(a, Enum.map(b, &(1 / &1)), [+0.0])
+
+  defp node(:/, a, b) when is_list(a) do
+    {:call, :math2_const, [b, :VIPS_OPERATION_MATH2_POW, [-1.0]]}
+    |> linear(a, [+0.0])
+  end
+
+  defp node(:/, a, b), do: {:call, :divide, [a, b]}
+
+  defp node(:**, a, b) when is_list(b),
+    do: {:call, :math2_const, [a, :VIPS_OPERATION_MATH2_POW, b]}
+
+  defp node(:**, a, b) when is_list(a),
+    do: {:call, :math2_const, [b, :VIPS_OPERATION_MATH2_WOP, a]}
+
+  defp node(:**, a, b), do: {:call, :math2, [a, b, :VIPS_OPERATION_MATH2_POW]}
+
+  defp node(op, a, b) do
+    {op_enum, inv_op_enum} = Map.fetch!(@relational, op)
+
+    cond do
+      is_list(b) -> {:call, :relational_const, [a, op_enum, b]}
+      is_list(a) -> {:call, :relational_const, [b, inv_op_enum, a]}
+      true -> {:call, :relational, [a, b, op_enum]}
+    end
+  end
+
+  # (x * a1 + b1) * a2 + b2 = x * (a1 * a2) + (b1 * a2 + b2)
+  defp linear({:linear, input, a1, b1} = inner, a2, b2) do
+    case broadcast_length([a1, b1, a2, b2]) do
+      {:ok, n} ->
+        [a1, b1, a2, b2] = Enum.map([a1, b1, a2, b2], &broadcast(&1, n))
+
+        a = Enum.zip_with(a1, a2, &(&1 * &2))
+        b = Enum.zip_with([b1, a2, b2], fn [b1, a2, b2] -> b1 * a2 + b2 end)
+
+        {:linear, input, a, b}
+
+      :error ->
+        {:linear, inner, a2, b2}
+    end
+  end
+
+  defp linear(input, a, b), do: {:linear, input, a, b}
+
+  # lists of length 1 apply to every band
+  defp broadcast_length(lists) do
+    lengths = lists |> Enum.map(&length/1) |> Enum.uniq() |> Enum.reject(&(&1 == 1))
+
+    case lengths do
+      [] -> {:ok, 1}
+      [n] -> {:ok, n}
+      _ -> :error
+    end
+  end
+
+  defp broadcast([value], n), do: List.duplicate(value, n)
+  defp broadcast(list, _n), do: list
+
+  defp emit(pipeline, %Image{} = image), do: {pipeline, image}
+  defp emit(pipeline, value) when not is_tuple(value), do: {pipeline, value}
+
+  defp emit(pipeline, {:linear, input, a, b}) do
+    {pipeline, input} = emit(pipeline, input)
+    Pipeline.add(pipeline, :linear, [input, a, b])
+  end
+
+  defp emit(pipeline, {:call, operation, args}) do
+    {pipeline, args} = Enum.map_reduce(args, pipeline, &emit_arg/2)
+    Pipeline.add(pipeline, operation, args)
+  end
+
+  defp emit_arg(arg, pipeline) do
+    {pipeline, arg} = emit(pipeline, arg)
+    {arg, pipeline}
+  end
+end
@@ -0,0 +1,46 @@
+defmodule Vix.SourceStream do
+  @moduledoc false
+
+  # Feeds a loader from the process which created the stream. See
+  # `c_src/source_stream.c`.
+
+  alias Vix.Nif
+  alias __MODULE__
+
+  @type t() :: %SourceStream{}
+
+  defstruct [:stream, :ref, :source]
+
+  # bytes queued ahead of the loader before the producer has to wait
+  @max_queued_bytes 1024 * 1024
+
+  @spec new() :: {:ok, t()} | {:error, term}
+  def new do
+    with {:ok, {stream, ref, source}} <- Nif.nif_source_stream_new(@max_queued_bytes) do
+      {:ok, %SourceStream{stream: stream, ref: ref, source: %Vix.Vips.Source{ref: source}}}
+    end
+  end
+
+  @spec write(t(), iodata) :: :ok | {:error, :closed} | {:error, term}
+  def write(%SourceStream{stream: stream, ref: ref}, iodata) do
+    case Nif.nif_source_stream_write(stream, :erlang.iolist_to_iovec(iodata)) do
+      :wait ->
+        receive do
+          {^ref, :ready} -> :ok
+        end
+
+      ret ->
+        ret
+    end
+  end
+
+  @spec finish(t()) :: :ok
+  def finish(%SourceStream{stream: stream}) do
+    Nif.nif_source_stream_finish(stream)
+  end
+
+  @spec close(t()) :: :ok
+  def close(%SourceStream{stream: stream}) do
+    Nif.nif_source_stream_close(stream)
+  end
+end
@@ -0,0 +1,117 @@
+defmodule Vix.TargetStream do
+  @moduledoc false
+
+  # Receives the output of a saver as messages sent directly by the
+  # NIF. See `c_src/target_stream.c`.
+
+  alias Vix.Nif
+  alias __MODULE__
+
+  @type t() :: %TargetStream{}
+
+  defstruct [:stream, :ref, :task_pid, :monitor, seq: 0, pending: %{}, eof: false, result: nil]
+
+  # number of 64KiB chunks the saver may encode ahead of the consumer
+  @credits 4
+
+  @spec new(Vix.Vips.Image.t(), String.t(), keyword) :: {:ok, t()} | {:error, term}
+  def new(image, suffix, opts) do
+    with {:ok, {stream, ref, target}} <- Nif.nif_target_stream_new(@credits) do
+      {pid, monitor} = start_task(image, %Vix.Vips.Target{ref: target}, suffix, opts, ref)
+      {:ok, %TargetStream{stream: stream, ref: ref, task_pid: pid, monitor: monitor}}
+    end
+  end
+
+  @spec read(t()) :: {:ok, binary, t()} | {:eof, t()} | {:error, term}
+  def read(%TargetStream{eof: true, result: :ok} = state) do
+    {:eof, state}
+  end
+
+  def read(%TargetStream{seq: seq, pending: pending} = state) do
+    case Map.pop(pending, seq) do
+      {nil, _pending} ->
+        await(state)
+
+      {payload, pending} ->
+        handle_payload(payload, %TargetStream{state | pending: pending})
+    end
+  end
+
+  @spec close(t()) :: :ok
+  def close(%TargetStream{stream: stream, ref: ref, task_pid: pid, monitor: monitor}) do
+    # fails pending and future writes of the saver
+    :ok = Nif.nif_target_stream_close(stream)
+
+    if monitor do
+      Process.exit(pid, :kill)
+
+      # the task exits once the saver returns, and anything it sent
+      # arrives before its :DOWN, so the flush below gets all of it
+      receive do
+        {:DOWN, ^monitor, :process, ^pid, _reason} -> :ok
+      end
+    end
+
+    flush_messages(ref)
+  end
+
+  defp await(%TargetStream{ref: ref, seq: seq, monitor: monitor} = state) do
+    receive do
+      {^ref, ^seq, payload} ->
+        handle_payload(payload, state)
+
+      {^ref, :result, {:error, _reason} = error} ->
+        error
+
+      {^ref, :result, _} ->
+        read(%TargetStream{state | result: :ok})
+
+      # chunks written from different threads can arrive out of order
+      {^ref, n, payload} when is_integer(n) ->
+        await(%TargetStream{state | pending: Map.put(state.pending, n, payload)})
+
+      {:DOWN, ^monitor, :process, _pid, :normal} ->
+        await(%TargetStream{state | monitor: nil})
+
+      {:DOWN, ^monitor, :process, _pid, reason} ->
+        {:error, reason}
+    end
+  end
+
+  defp handle_payload(:eof, state) do
+    read(%TargetStream{state | eof: true, seq: state.seq + 1})
+  end
+
+  defp handle_payload(bin, state) when is_binary(bin) do
+    :ok = Nif.nif_target_stream_credit(state.stream, 1)
+    {:ok, bin, %TargetStream{state | seq: state.seq + 1}}
+  end
+
+  defp flush_messages(ref) do
+    receive do
+      {^ref, _, _} -> flush_messages(ref)
+    after
+      0 -> :ok
+    end
+  end
+
+  @spec start_task(Vix.Vips.Image.t(), Vix.Vips.Target.t(), String.t(), keyword, reference) ::
+          {pid, reference}
+  defp start_task(image, target, suffix, opts, ref) do
+    consumer = self()
+
+    spawn_monitor(fn ->
+      send(consumer, {ref, :result, save(image, target, suffix, opts)})
+    end)
+  end
+
+  defp save(%Vix.Vips.Image{} = image, target, suffix, []) do
+    Nif.nif_image_to_target(image.ref, target.ref, suffix)
+  end
+
+  defp save(image, target, suffix, opts) do
+    with {:ok, saver} <- Vix.Vips.Foreign.find_save_target(suffix) do
+      Vix.Vips.Operation.Helper.operation_call(saver, [image, target], opts)
+    end
+  end
+end
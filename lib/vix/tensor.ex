@@ -29,12 +29,16 @@ defmodule Vix.Tensor do
   @typedoc """
   Struct to hold raw pixel data returned by the Libvips along with metadata about the binary.
 
-  `:names` will always be `[:height, :width, :bands]`
+  `:names` is `[:height, :width, :bands]` for a single image. Tensors
+  of a batch of images, see `Vix.Vips.Image.write_batch_to_tensor/2`,
+  have a leading `:batch` dimension.
   """
 
   @type t() :: %__MODULE__{
           data: binary(),
-          shape: {non_neg_integer(), non_neg_integer(), non_neg_integer()},
+          shape:
+            {non_neg_integer(), non_neg_integer(), non_neg_integer()}
+            | {non_neg_integer(), non_neg_integer(), non_neg_integer(), non_neg_integer()},
           names: list(),
           type: tensor_type()
         }
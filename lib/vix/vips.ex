@@ -105,6 +105,70 @@ defmodule Vix.Vips do
     Nif.nif_vips_tracked_get_mem_highwater()
   end
 
+  @doc """
+  Returns call statistics of every operation called so far.
+
+  Counters are maintained natively for each operation and include
+  calls made through `Vix.Vips.Operation`, `Vix.Vips.Async` and
+  `Vix.Vips.Pipeline`. Time is measured around building the
+  operation, which for most operations is cheap since the pixels are
+  only computed when the image is written.
+
+  Each entry has
+
+    * `:calls` - number of calls
+    * `:errors` - number of calls which returned an error
+    * `:total_time` - sum of the call durations in microseconds
+    * `:histogram` - list of `{upper_bound, count}` where `count` is
+      the number of calls which took less than `upper_bound`
+      microseconds but not less than the previous bound. The last
+      bound is `:infinity`
+
+  ```elixir
+  iex> Vix.Vips.stats()["thumbnail_image"]
+  %{calls: 120, errors: 0, total_time: 51234, histogram: [{1, 0}, {2, 0}, ...]}
+  ```
+  """
+  @doc since: "0.42.0"
+  @spec stats() :: %{
+          String.t() => %{
+            calls: non_neg_integer(),
+            errors: non_neg_integer(),
+            total_time: non_neg_integer(),
+            histogram: [{pos_integer() | :infinity, non_neg_integer()}]
+          }
+        }
+  def stats do
+    Map.new(Nif.nif_vips_operation_stats(), fn {name, calls, errors, total_time, histogram} ->
+      {name,
+       %{
+         calls: calls,
+         errors: errors,
+         total_time: total_time,
+         histogram: Enum.zip(histogram_bounds(length(histogram)), histogram)
+       }}
+    end)
+  end
+
+  defp histogram_bounds(count) do
+    Enum.map(0..(count - 2), &Integer.pow(2, &1)) ++ [:infinity]
+  end
+
+  @doc """
+  Returns the number of native objects waiting to be released.
+
+  Images and other native objects are not released by the garbage
+  collector directly, since releasing a libvips object can take a
+  while. They are queued and released by a background thread
+  instead. A depth which keeps growing means objects are collected
+  faster than the thread can release them.
+  """
+  @doc since: "0.42.0"
+  @spec janitor_queue_depth() :: non_neg_integer()
+  def janitor_queue_depth do
+    Nif.nif_janitor_queue_depth()
+  end
+
   @doc """
   Get installed vips version
   """
@@ -10,7 +10,9 @@ defmodule Vix.Vips.ArrayHelper do
       nested_type: Vix.GObject.Int,
       nested_typespec: Macro.escape(quote(do: integer())),
       to_nif_term: &Nif.nif_int_array/1,
-      to_erl_term: &Nif.nif_vips_int_array_to_erl_list/1
+      to_erl_term: &Nif.nif_vips_int_array_to_erl_list/1,
+      from_binary: &Nif.nif_int_array_from_binary/1,
+      to_binary: &Nif.nif_vips_int_array_to_binary/1
     })
 
     def_vips_array(env, %{
@@ -18,7 +20,9 @@ defmodule Vix.Vips.ArrayHelper do
       nested_type: Vix.GObject.Double,
       nested_typespec: Macro.escape(quote(do: float())),
       to_nif_term: &Nif.nif_double_array/1,
-      to_erl_term: &Nif.nif_vips_double_array_to_erl_list/1
+      to_erl_term: &Nif.nif_vips_double_array_to_erl_list/1,
+      from_binary: &Nif.nif_double_array_from_binary/1,
+      to_binary: &Nif.nif_vips_double_array_to_binary/1
     })
 
     def_vips_array(env, %{
@@ -41,6 +45,7 @@ defmodule Vix.Vips.ArrayHelper do
 
   def def_vips_array(env, opts) do
     module_name = Module.concat([Vix.Vips.Array, opts.module_name])
+    binary? = Map.has_key?(opts, :from_binary)
 
     contents =
       quote do
@@ -60,14 +65,22 @@ defmodule Vix.Vips.ArrayHelper do
         def typespec do
           nested_typespec = unquote(opts.nested_typespec)
 
-          quote do
-            list(unquote(nested_typespec))
+          if unquote(binary?) do
+            quote do
+              list(unquote(nested_typespec)) | binary()
+            end
+          else
+            quote do
+              list(unquote(nested_typespec))
+            end
           end
         end
 
         @impl Type
         def default(default), do: default
 
+        unquote(def_from_binary(opts))
+
         @impl Type
         def to_nif_term(value, data) do
           Enum.map(value, fn nested_value ->
@@ -84,10 +97,39 @@ defmodule Vix.Vips.ArrayHelper do
             @nested_type.to_erl_term(nested_value)
           end)
         end
+
+        unquote(def_to_binary(opts))
       end
 
     Module.create(module_name, contents, line: env.line, file: env.file)
   end
+
+  # Arrays of numbers can also be passed as a packed native-endian
+  # binary (`<<x::native-signed-32, ...>>` for ints and
+  # `<<x::native-float-64, ...>>` for doubles), which is copied as is
+  # instead of being converted element by element
+  defp def_from_binary(%{from_binary: from_binary}) do
+    quote do
+      @impl Type
+      def to_nif_term(value, _data) when is_binary(value) do
+        unquote(from_binary).(value)
+      end
+    end
+  end
+
+  defp def_from_binary(_opts), do: nil
+
+  defp def_to_binary(%{to_binary: to_binary}) do
+    quote do
+      @spec to_binary(t()) :: binary()
+      def to_binary(value) do
+        {:ok, binary} = unquote(to_binary).(value)
+        binary
+      end
+    end
+  end
+
+  defp def_to_binary(_opts), do: nil
 end
 
 defmodule Vix.Vips.Array do
@@ -0,0 +1,97 @@
+defmodule Vix.Vips.Async do
+  @moduledoc """
+  Run operations on a native worker pool without blocking the caller.
+
+  Regular operation calls occupy a dirty scheduler until the operation
+  is built. With `call/3` the operation is queued on a pool of native
+  threads owned by the NIF instead, and the caller gets a reply message
+  when it completes. This allows a process to run several operations
+  concurrently and to wait for them with a timeout.
+
+  ```elixir
+  alias Vix.Vips.Async
+
+  tasks = Enum.map(images, &Async.call(:thumbnail_image, [&1, 200]))
+  results = Enum.map(tasks, &Async.await(&1, 10_000))
+  ```
+
+  The reply is `{ref, result}` where `ref` is `async.ref`. It can be
+  received manually and converted with `result/2`.
+
+  ## Configuration
+
+  Size of the pool and maximum number of queued operations can be set
+  in the application config. Both are read when the NIF is loaded.
+
+  ```elixir
+  config :vix,
+    operation_pool_size: 8,
+    operation_pool_queue_depth: 1024
+  ```
+
+  Pool size defaults to the number of online schedulers and queue
+  depth to 1024. A queue depth of `0` disables the limit. When the
+  queue is full `call/3` returns `{:error, :queue_full}`.
+
+  Note that the operation is executed even if the calling process
+  exits before it completes, the result is discarded.
+  """
+
+  alias Vix.Vips.Operation.Helper
+  alias __MODULE__
+
+  @type t() :: %Async{ref: reference(), spec: map(), array_format: :list | :binary}
+
+  defstruct [:ref, :spec, array_format: :list]
+
+  @doc """
+  Queues operation `name` with the same arguments as the matching
+  `Vix.Vips.Operation` function.
+
+  Returns a handle to be passed to `await/2`.
+  """
+  @spec call(atom() | String.t(), [term()], keyword()) :: t() | {:error, term()}
+  def call(name, args, opts \\ []) do
+    name = to_string(name)
+    spec = Helper.cached_operation_args_spec(name)
+
+    if Enum.any?(spec.in_req_spec, &(&1.type == "MutableVipsImage")) do
+      raise ArgumentError, "mutable operation #{name} can not be called asynchronously"
+    end
+
+    {array_format, opts} = Helper.pop_array_format(opts)
+
+    with nif_args when is_list(nif_args) <-
+           Helper.cast_arguments_to_nif_terms(args, opts, spec.in_req_spec, spec.in_opt_spec),
+         {:ok, ref} <- Vix.Nif.nif_vips_operation_call_async(name, nif_args) do
+      %Async{ref: ref, spec: spec, array_format: array_format}
+    end
+  end
+
+  @doc """
+  Waits for the result of an operation queued with `call/3`.
+
+  Returns the same value as the matching `Vix.Vips.Operation`
+  function. Like `Task.await/2`, it exits if no reply arrives within
+  `timeout` milliseconds.
+  """
+  @spec await(t(), timeout()) :: term()
+  def await(%Async{ref: ref} = async, timeout \\ 5000) do
+    receive do
+      {^ref, reply} ->
+        result(async, reply)
+    after
+      timeout ->
+        exit({:timeout, {__MODULE__, :await, [async, timeout]}})
+    end
+  end
+
+  @doc """
+  Converts a raw reply message of an operation to the return value of
+  the matching `Vix.Vips.Operation` function.
+  """
+  @spec result(t(), term()) :: term()
+  def result(%Async{spec: spec, array_format: array_format}, reply) do
+    Helper.nif_result_to_erl_terms(reply, spec, array_format)
+  end
+end
@@ -2,7 +2,7 @@ defmodule Vix.Vips.EnumHelper do
   @moduledoc false
 
   def __before_compile__(env) do
-    for {name, enum} <- Vix.Nif.nif_vips_enum_list() do
+    for {name, enum} <- Vix.Vips.Operation.Helper.vips_enum_list() do
       def_vips_enum(name, enum, env)
     end
 
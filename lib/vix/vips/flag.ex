@@ -2,7 +2,7 @@ defmodule Vix.Vips.FlagHelper do
   @moduledoc false
 
   def __before_compile__(env) do
-    for {name, flag} <- Vix.Nif.nif_vips_flag_list() do
+    for {name, flag} <- Vix.Vips.Operation.Helper.vips_flag_list() do
       def_vips_flag(name, flag, env)
     end
 
@@ -12,7 +12,9 @@ defmodule Vix.Vips.Foreign do
 
   @spec find_save_buffer(String.t()) :: {:ok, operation_name} | {:error, String.t()}
   def find_save_buffer(suffix) do
-    Nif.nif_foreign_find_save_buffer(suffix)
+    with :error <- lookup_saver(:buffer, suffix) do
+      Nif.nif_foreign_find_save_buffer(suffix)
+    end
   end
 
   @doc """
@@ -28,7 +30,9 @@ defmodule Vix.Vips.Foreign do
   """
   @spec find_save(String.t()) :: {:ok, operation_name} | {:error, String.t()}
   def find_save(filename) do
-    Nif.nif_foreign_find_save(filename)
+    with :error <- lookup_saver(:file, filename) do
+      Nif.nif_foreign_find_save(filename)
+    end
   end
 
   @spec find_load_source(Vix.Vips.Source.t()) :: {:ok, operation_name} | {:error, String.t()}
@@ -43,19 +47,53 @@ defmodule Vix.Vips.Foreign do
     if suffix in [".tif", ".tiff"] do
       {:error, "Failed to find saver for the target"}
     else
-      Nif.nif_foreign_find_save_target(suffix)
+      with :error <- lookup_saver(:target, suffix) do
+        Nif.nif_foreign_find_save_target(suffix)
+      end
     end
   end
 
-  def get_suffixes do
-    with {:ok, suffixes} <- Nif.nif_foreign_get_suffixes() do
-      {:ok, Enum.uniq(suffixes)}
+  @spec get_suffixes :: {:ok, [String.t()]}
+  def get_suffixes, do: cached(:suffixes, &Nif.nif_foreign_get_suffixes/0)
+
+  @spec get_loader_suffixes :: {:ok, [String.t()]}
+  def get_loader_suffixes, do: cached(:loader_suffixes, &Nif.nif_foreign_get_loader_suffixes/0)
+
+  @doc """
+  Returns the saver libvips picks for each suffix, for files, buffers
+  and targets
+  """
+  @spec get_savers :: {:ok, %{(:file | :buffer | :target) => %{String.t() => operation_name}}}
+  def get_savers, do: cached(:savers, &Nif.nif_foreign_get_savers/0)
+
+  defp lookup_saver(kind, name) do
+    {:ok, savers} = get_savers()
+    Map.fetch(Map.fetch!(savers, kind), suffix(name))
+  end
+
+  # `name` is either a filename or a suffix such as ".jpg". Names the
+  # table does not know, such as ones with save options, are left to
+  # the libvips search
+  defp suffix(name) do
+    case Path.extname(name) do
+      "" -> String.downcase(name)
+      ext -> String.downcase(ext)
     end
   end
 
-  def get_loader_suffixes do
-    with {:ok, suffixes} <- Nif.nif_foreign_get_loader_suffixes() do
-      {:ok, Enum.uniq(suffixes)}
+  # tables are built when the NIF is loaded and do not change for the
+  # lifetime of the VM
+  defp cached(name, fun) do
+    key = {__MODULE__, name}
+
+    case :persistent_term.get(key, nil) do
+      nil ->
+        {:ok, _} = table = fun.()
+        :persistent_term.put(key, table)
+        table
+
+      table ->
+        table
     end
   end
 end
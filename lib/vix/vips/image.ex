@@ -71,6 +71,18 @@ defmodule Vix.Vips.Image do
 
   See `Vix.Vips.Operation` for available image processing operations.
 
+  ## Memory
+
+  The BEAM sees an image as a small reference, whatever the size of
+  its pixels, so holding large images puts no pressure on the garbage
+  collector of the process. An image is freed only once every term
+  referencing it has been garbage collected, which for a long lived
+  process churning through images can be much later than expected.
+  This holds for lazy images too, which keep their source and the tile
+  caches of their pipeline alive.
+
+  Use `release/1` to free an image once it is no longer needed.
+
   """
 
   defstruct [:ref]
@@ -703,38 +715,75 @@ defmodule Vix.Vips.Image do
 
     pid =
       spawn_link(fn ->
-        {pipe, source} = Vix.SourcePipe.new()
-        send(parent, {self(), source})
-
-        Enum.each(enum, fn iodata ->
-          bin =
-            try do
-              IO.iodata_to_binary(iodata)
-            rescue
-              ArgumentError ->
-                log_warn("argument must be stream of iodata")
-                Vix.SourcePipe.stop(pipe)
-                exit(:normal)
+        {:ok, stream} = Vix.SourceStream.new()
+        send(parent, {self(), stream.source})
+
+        Enum.reduce_while(enum, :ok, fn iodata, :ok ->
+          try do
+            case Vix.SourceStream.write(stream, iodata) do
+              :ok -> {:cont, :ok}
+              # source is released, nothing reads from it anymore
+              {:error, :closed} -> {:halt, :closed}
             end
-
-          :ok = Vix.SourcePipe.write(pipe, bin)
+          rescue
+            ArgumentError ->
+              log_warn("argument must be stream of iodata")
+              {:halt, :invalid}
+          end
         end)
-
-        Vix.SourcePipe.stop(pipe)
+        |> case do
+          :ok -> Vix.SourceStream.finish(stream)
+          :closed -> :ok
+          :invalid -> Vix.SourceStream.close(stream)
+        end
       end)
 
     receive do
-      # for backward compatibility
-      {^pid, source} when is_binary(opts) ->
-        Nif.nif_image_new_from_source(source.ref, opts)
-        |> wrap_type()
-
       {^pid, source} ->
-        with :ok <- validate_options(opts),
-             {:ok, loader} <- Vix.Vips.Foreign.find_load_source(source),
-             {:ok, {ref, _optional}} <- Operation.Helper.operation_call(loader, [source], opts) do
-          {:ok, wrap_type(ref)}
-        end
+        new_from_source(source, opts)
+    end
+  end
+
+  @doc """
+  Creates a new image from a `Vix.Vips.SeekableSource` backend.
+
+  Unlike `new_from_enum/2`, the loader can read the input at any
+  offset. Formats which need random access, such as TIFF, load
+  without buffering the whole input, and only the parts being used
+  are read.
+
+  `source` is `{module, args}` where `module` implements the
+  `Vix.Vips.SeekableSource` behaviour and `args` is passed to its
+  `init/1` callback.
+
+  ## Examples
+
+      {:ok, image} =
+        Image.new_from_seekable_source({Vix.Vips.SeekableSource.File, "large.tif"}, page: 3)
+
+  ## Format Options
+
+  To see format-specific options, check [Operation](./search.html?q=load+-buffer+-filename+-profile) module.
+  """
+  @doc since: "0.42.0"
+  @spec new_from_seekable_source({module, term}, keyword) :: {:ok, t()} | {:error, term()}
+  def new_from_seekable_source({module, _args} = source, opts \\ []) when is_atom(module) do
+    with {:ok, source} <- Vix.Vips.SeekableSource.start(source) do
+      new_from_source(source, opts)
+    end
+  end
+
+  # for backward compatibility
+  defp new_from_source(source, opts) when is_binary(opts) do
+    Nif.nif_image_new_from_source(source.ref, opts)
+    |> wrap_type()
+  end
+
+  defp new_from_source(source, opts) do
+    with :ok <- validate_options(opts),
+         {:ok, loader} <- Vix.Vips.Foreign.find_load_source(source),
+         {:ok, {ref, _optional}} <- Operation.Helper.operation_call(loader, [source], opts) do
+      {:ok, wrap_type(ref)}
     end
   end
 
@@ -789,22 +838,23 @@ defmodule Vix.Vips.Image do
       fn ->
         init_write_stream(image, suffix, opts)
       end,
-      fn pipe ->
-        ret = Vix.TargetPipe.read(pipe)
+      fn stream ->
+        case Vix.TargetStream.read(stream) do
+          {:eof, stream} ->
+            {:halt, stream}
 
-        case ret do
-          :eof ->
-            {:halt, pipe}
+          {:ok, bin, stream} ->
+            {[bin], stream}
 
-          {:ok, bin} ->
-            {[bin], pipe}
+          {:error, reason} when is_binary(reason) ->
+            raise Error, reason
 
           {:error, reason} ->
-            raise Error, reason
+            raise Error, inspect(reason)
         end
       end,
-      fn pipe ->
-        Vix.TargetPipe.stop(pipe)
+      fn stream ->
+        Vix.TargetStream.close(stream)
       end
     )
   end
@@ -923,6 +973,30 @@ defmodule Vix.Vips.Image do
     |> wrap_type()
   end
 
+  @doc """
+  Releases the image without waiting for garbage collection.
+
+  Any function called with the image afterwards returns an error,
+  including from other processes holding it. Calls already running
+  with the image are not affected, the image is freed once they
+  return.
+
+  Images derived from this one keep what they need of it alive, and
+  so does the libvips operation cache for images passed to cached
+  operations, see `Vix.Vips.cache_set_max/1`. The memory is freed once
+  those are gone too.
+
+  ```elixir
+  {:ok, thumb} = Operation.thumbnail_image(image, 128)
+  :ok = Image.release(image)
+  ```
+  """
+  @doc since: "0.42.0"
+  @spec release(t()) :: :ok
+  def release(%Image{ref: vips_image}) do
+    Nif.nif_g_object_release(vips_image)
+  end
+
   @doc """
   Writes a VIPS image to a file in the format determined by the file extension.
 
@@ -956,6 +1030,21 @@ defmodule Vix.Vips.Image do
       # JPEG with quality and metadata stripping
       :ok = Image.write_to_file(image, "output.jpg", Q: 90, strip: true)
 
+  Aborting the write if it takes more than 5 seconds:
+
+      {:error, :cancelled} = Image.write_to_file(huge_image, "output.png", timeout: 5_000)
+
+  ## Cancellation
+
+  Encoding is where the deferred pipeline is actually computed, so it
+  can take a while for large images. Pass `:timeout` (in milliseconds)
+  and/or `:owner` (a pid) to abort the computation once the timeout
+  expires or the owner process exits. Typically the owner is the
+  process waiting for the result, such as the process handling the
+  request when the image is encoded in a separate task. In both cases
+  `{:error, :cancelled}` is returned. `timeout: :infinity` sets no
+  deadline.
+
   ## Advanced Usage
 
   For more control, use format-specific savers from `Vix.Vips.Operation`:
@@ -972,7 +1061,7 @@ defmodule Vix.Vips.Image do
 
     with :ok <- validate_options(opts),
          {:ok, saver} <- Vix.Vips.Foreign.find_save(path) do
-      Operation.Helper.operation_call(saver, [image, path], opts)
+      saver_call(saver, [image, path], opts)
     end
   end
 
@@ -981,6 +1070,58 @@ defmodule Vix.Vips.Image do
     Nif.nif_image_write_to_file(vips_image, path)
   end
 
+  @doc """
+  Encodes the image in the format of `suffix` and writes it to the file
+  descriptor `fd`.
+
+  The encoder writes straight to the descriptor, so no binary of the
+  whole encoded image is created. This is useful to send an image over
+  a socket, for example with the `:socket` module:
+
+      {:ok, fd} = :socket.getopt(socket, {:otp, :fd})
+      :ok = Image.write_to_fd(image, fd, ".jpg", Q: 90)
+
+  `fd` is duplicated and the caller keeps ownership of it. Nonblocking
+  descriptors are supported, the write waits until the descriptor is
+  writable. The caller must not write to the descriptor concurrently.
+
+  ## Options
+
+  * `:send_timeout` - maximum time in milliseconds to wait for the
+    descriptor to become writable. Defaults to `:infinity`.
+
+  Format options and the options described in `write_to_file/3`
+  "Cancellation" section are accepted as well.
+  """
+  @doc since: "0.42.0"
+  @spec write_to_fd(t(), non_neg_integer, String.t(), keyword) :: :ok | {:error, term()}
+  def write_to_fd(%Image{ref: _} = image, fd, suffix, opts \\ [])
+      when is_integer(fd) and fd >= 0 do
+    {send_timeout, opts} = Keyword.pop(opts, :send_timeout, :infinity)
+    suffix = normalize_string(suffix)
+
+    with :ok <- validate_options(opts),
+         {:ok, poll_timeout} <- poll_timeout(send_timeout),
+         {:ok, target} <- Nif.nif_fd_target_new(fd, poll_timeout) do
+      target = %Vix.Vips.Target{ref: target}
+
+      if opts == [] do
+        Nif.nif_image_to_target(image.ref, target.ref, suffix)
+      else
+        with {:ok, saver} <- Vix.Vips.Foreign.find_save_target(suffix) do
+          saver_call(saver, [image, target], opts)
+        end
+      end
+    end
+  end
+
+  defp poll_timeout(:infinity), do: {:ok, -1}
+  defp poll_timeout(timeout) when is_integer(timeout) and timeout >= 0, do: {:ok, timeout}
+
+  defp poll_timeout(timeout) do
+    {:error, "send_timeout must be a non-negative integer or :infinity, got: #{inspect(timeout)}"}
+  end
+
   @doc """
   Converts a VIPS image to a binary representation in the specified format.
 
@@ -1012,6 +1153,11 @@ defmodule Vix.Vips.Image do
       # PNG with maximum compression
       {:ok, png_binary} = Image.write_to_buffer(image, ".png", compression: 9)
 
+  ## Cancellation
+
+  `:timeout` and `:owner` are accepted, see the "Cancellation" section
+  of `write_to_file/3`.
+
   Web application example:
 
       def show_image(conn, %{"id" => id}) do
@@ -1030,7 +1176,7 @@ defmodule Vix.Vips.Image do
   def write_to_buffer(%Image{ref: _} = image, suffix, opts) do
     with :ok <- validate_options(opts),
          {:ok, saver} <- Vix.Vips.Foreign.find_save_buffer(normalize_string(suffix)) do
-      Operation.Helper.operation_call(saver, [image], opts)
+      saver_call(saver, [image], opts)
     end
   end
 
@@ -1063,6 +1209,12 @@ defmodule Vix.Vips.Image do
   Depending on the caching mechanism and image construction, VIPS may need to run all
   the operations in the pipeline to produce the pixel data.
 
+  When the pixels are already in memory, such as for images returned by
+  `copy_memory/1` or `new_from_binary/5`, the binary shares them with the
+  image instead of copying them, and keeps them alive after the image is
+  released. `Nx.from_binary/2` with the binary backend uses the binary
+  as is, so the tensor is built without copying the pixels.
+
   ## Endianness Considerations
 
   The binary data in the tensor uses native endianness. When processing this
@@ -1103,6 +1255,95 @@ defmodule Vix.Vips.Image do
     end
   end
 
+  @doc """
+  Writes a batch of images to a single 4D `Vix.Tensor` of floats, ready
+  to be passed to a model.
+
+  All images must have the same width, height and number of bands, band
+  formats can differ. Pixel values are normalized with the per band
+  `:mean` and `:std` as `(value - mean) / std` while they are written,
+  and images are converted in parallel.
+
+  ## Options
+
+  * `:layout` - `:nhwc` (default) or `:nchw`. Sets the order of the
+    dimensions, `:nchw` writes each band as a separate plane
+  * `:type` - `{:f, 32}` (default) or `{:f, 64}`
+  * `:mean` - number, or list with a number for each band, subtracted
+    from the values. Defaults to `0`
+  * `:std` - number, or list with a number for each band, the values
+    are divided by. Defaults to `1`
+
+  ## Examples
+
+      {:ok, tensor} =
+        Image.write_batch_to_tensor(images,
+          layout: :nchw,
+          mean: [0.485 * 255, 0.456 * 255, 0.406 * 255],
+          std: [0.229 * 255, 0.224 * 255, 0.225 * 255]
+        )
+
+      %Vix.Tensor{
+        shape: {batch_size, 3, height, width},
+        names: [:batch, :bands, :height, :width],
+        type: {:f, 32}
+      } = tensor
+
+  """
+  @doc since: "0.42.0"
+  @spec write_batch_to_tensor([t()], keyword) :: {:ok, Vix.Tensor.t()} | {:error, term()}
+  def write_batch_to_tensor(images, opts \\ []) when is_list(images) do
+    channels_first =
+      case Keyword.get(opts, :layout, :nhwc) do
+        :nhwc -> false
+        :nchw -> true
+        layout -> raise ArgumentError, "layout must be :nhwc or :nchw, got: #{inspect(layout)}"
+      end
+
+    {type, band_format} =
+      case Keyword.get(opts, :type, {:f, 32}) do
+        {:f, 32} -> {{:f, 32}, :VIPS_FORMAT_FLOAT}
+        {:f, 64} -> {{:f, 64}, :VIPS_FORMAT_DOUBLE}
+        type -> raise ArgumentError, "type must be {:f, 32} or {:f, 64}, got: #{inspect(type)}"
+      end
+
+    mean = band_values(opts, :mean, 0)
+    std = band_values(opts, :std, 1)
+
+    if Enum.any?(std, &(&1 == 0)) do
+      raise ArgumentError, "std must not be zero"
+    end
+
+    refs = Enum.map(images, fn %Image{ref: ref} -> ref end)
+    band_format = Vix.Vips.Enum.VipsBandFormat.to_nif_term(band_format, nil)
+
+    case Nif.nif_image_write_batch_to_binary(refs, channels_first, band_format, mean, std) do
+      {:ok, {binary, n, height, width, bands}} ->
+        {shape, names} =
+          if channels_first do
+            {{n, bands, height, width}, [:batch, :bands, :height, :width]}
+          else
+            {{n, height, width, bands}, [:batch, :height, :width, :bands]}
+          end
+
+        {:ok, %Vix.Tensor{data: binary, shape: shape, names: names, type: type}}
+
+      {:error, _} = error ->
+        error
+    end
+  end
+
+  defp band_values(opts, name, default) do
+    values = List.wrap(Keyword.get(opts, name, default))
+
+    if values == [] or not Enum.all?(values, &is_number/1) do
+      raise ArgumentError,
+            "#{name} must be a number or a list of numbers, got: #{inspect(values)}"
+    end
+
+    Enum.map(values, &(&1 * 1.0))
+  end
+
   @doc """
   Extracts raw pixel data from a VIPS image as a binary term.
 
@@ -1182,12 +1423,161 @@ defmodule Vix.Vips.Image do
     end
   end
 
+  @doc """
+  Extracts raw pixel data of many areas of the image in a single call.
+
+  Each area is a keyword list with `:left`, `:top`, `:width`,
+  `:height`, `:band_start` and `:band_count`. Missing keys default to
+  the whole image, same as `extract_area/5` and `extract_band/3`
+  combined.
+
+  Areas are extracted in parallel. The image is computed once
+  through a shared tile cache, so overlapping areas do not
+  recompute the shared pixels. This is much faster than extracting
+  the areas one by one, for example when sampling patches for
+  training a model.
+
+  Returns a list of maps with `:binary`, `:width`, `:height`, `:bands`
+  and `:band_format`, in the same order as `areas`.
+
+  ## Options
+
+    * `:contiguous` - when `true`, returns all areas in a single
+      binary as `%{binary: binary, band_format: format, areas: areas}`
+      where each area has `:offset` and `:size` of its pixel data in
+      the binary along with `:width`, `:height` and `:bands`.
+      Defaults to `false`.
+
+  ## Examples
+
+      patches = for x <- [0, 100, 200], do: [left: x, top: 0, width: 224, height: 224]
+      {:ok, [%{binary: _, width: 224, height: 224} | _]} = Image.write_areas_to_binary(image, patches)
+
+  """
+  @doc since: "0.42.0"
+  @spec write_areas_to_binary(t(), [keyword], keyword) :: {:ok, [map] | map} | {:error, term()}
+  def write_areas_to_binary(%Image{ref: vips_image}, areas, opts \\ []) when is_list(areas) do
+    contiguous = Keyword.get(opts, :contiguous, false)
+    params = Enum.map(areas, &area_params/1)
+
+    case Nif.nif_image_write_areas_to_binary(vips_image, params, contiguous) do
+      {:ok, {binary, areas, band_format}} when is_binary(binary) ->
+        {:ok,
+         %{
+           binary: binary,
+           band_format: Vix.Vips.Enum.VipsBandFormat.to_erl_term(band_format),
+           areas:
+             Enum.map(areas, fn {offset, size, width, height, bands} ->
+               %{offset: offset, size: size, width: width, height: height, bands: bands}
+             end)
+         }}
+
+      {:ok, {areas, band_format}} ->
+        band_format = Vix.Vips.Enum.VipsBandFormat.to_erl_term(band_format)
+
+        {:ok,
+         Enum.map(areas, fn {binary, width, height, bands} ->
+           %{
+             binary: binary,
+             width: width,
+             height: height,
+             bands: bands,
+             band_format: band_format
+           }
+         end)}
+
+      {:error, _} = error ->
+        error
+    end
+  end
+
+  @doc """
+  Returns a stream of the pixel data of the image, as horizontal strips
+  or as tiles.
+
+  Unlike `write_to_binary/1`, the image is never computed in full.
+  Only the strips being read are computed and held in memory. This
+  makes it possible to process images which are too large to fit
+  in memory, such as feeding a huge scan into Nx strip by strip.
+
+  Each element is a map with `:left`, `:top`, `:width`, `:height`,
+  `:bands`, `:band_format` and the raw pixel `:binary` of that area,
+  same as `write_areas_to_binary/3`. Areas are emitted in row-major
+  order, left to right and then top to bottom.
+
+  ## Options
+
+    * `:tile_height` - height of each area. Defaults to `64`.
+    * `:tile_width` - width of each area. Defaults to the image width,
+      which means the image is read as full width strips.
+    * `:readahead` - number of areas computed together, in parallel,
+      per native call. Memory use is bounded by `readahead` times the
+      size of an area. Defaults to `Vix.Vips.concurrency_get/0`.
+
+  For images opened with sequential access, keep the default
+  `:tile_width` so the areas are requested strictly top to bottom.
+
+  ## Examples
+
+      {:ok, image} = Image.new_from_file("huge.tif", access: :VIPS_ACCESS_SEQUENTIAL)
+
+      image
+      |> Image.stream_pixels(tile_height: 256)
+      |> Enum.each(fn %{top: top, binary: pixels} -> process(top, pixels) end)
+
+  """
+  @doc since: "0.42.0"
+  @spec stream_pixels(t(), keyword) :: Enumerable.t()
+  def stream_pixels(%Image{} = image, opts \\ []) do
+    image_width = width(image)
+    image_height = height(image)
+
+    tile_width = Keyword.get(opts, :tile_width, image_width)
+    tile_height = Keyword.get(opts, :tile_height, 64)
+    readahead = Keyword.get(opts, :readahead, Vix.Vips.concurrency_get())
+
+    for {name, value} <- [tile_width: tile_width, tile_height: tile_height, readahead: readahead],
+        not (is_integer(value) and value > 0) do
+      raise ArgumentError, "#{name} must be a positive integer, got: #{inspect(value)}"
+    end
+
+    0..(image_height - 1)//tile_height
+    |> Stream.flat_map(fn top ->
+      Stream.map(0..(image_width - 1)//tile_width, fn left ->
+        [
+          left: left,
+          top: top,
+          width: min(tile_width, image_width - left),
+          height: min(tile_height, image_height - top)
+        ]
+      end)
+    end)
+    |> Stream.chunk_every(readahead)
+    |> Stream.flat_map(fn areas ->
+      case write_areas_to_binary(image, areas) do
+        {:ok, results} ->
+          Enum.zip_with(areas, results, fn area, result ->
+            Map.merge(result, %{left: area[:left], top: area[:top]})
+          end)
+
+        {:error, reason} when is_binary(reason) ->
+          raise Error, reason
+
+        {:error, reason} ->
+          raise Error, inspect(reason)
+      end
+    end)
+  end
+
+  defp area_params(params) do
+    Enum.map(~w(left top width height band_start band_count)a, fn key ->
+      params[key] || -1
+    end)
+  end
+
   @spec write_area_to_binary(t(), params :: keyword) :: {:ok, map} | {:error, term()}
   defp write_area_to_binary(%Image{ref: vips_image}, params \\ []) do
-    params =
-      Enum.map(~w(left top width height band_start band_count)a, fn key ->
-        params[key] || -1
-      end)
+    params = area_params(params)
 
     case Nif.nif_image_write_area_to_binary(vips_image, params) do
       {:ok, {binary, width, height, bands, band_format}} ->
@@ -1246,6 +1636,38 @@ defmodule Vix.Vips.Image do
     |> wrap_type()
   end
 
+  @doc """
+  Make a VipsImage matrix from a binary of native-endian doubles.
+
+  Same as `new_matrix_from_array/4`, but takes the values row by row as
+  a packed binary of `width * height` 64-bit floats. The binary is
+  copied into the image as is, which avoids converting large kernels
+  element by element.
+
+  ```elixir
+  kernel = for v <- [0, 1, 0, 1, 1, 1, 0, 1, 0], into: <<>>, do: <<v::native-float-64>>
+  {:ok, mask} = Image.new_matrix_from_binary(3, 3, kernel)
+  ```
+
+  An `Nx` tensor can be passed with `Nx.to_binary(Nx.as_type(tensor, :f64))`.
+
+  ## Optional
+  * scale - Default: 1
+  * offset - Default: 0
+  """
+  @doc since: "0.42.0"
+  @spec new_matrix_from_binary(pos_integer, pos_integer, binary, keyword()) ::
+          {:ok, t()} | {:error, term()}
+  def new_matrix_from_binary(width, height, binary, optional \\ [])
+      when is_integer(width) and width > 0 and is_integer(height) and height > 0 and
+             is_binary(binary) do
+    scale = to_double(optional[:scale], 1)
+    offset = to_double(optional[:offset], 0)
+
+    Nif.nif_image_new_matrix_from_binary(width, height, binary, scale, offset)
+    |> wrap_type()
+  end
+
   @doc """
   Make a VipsImage from 1D or 2D list.
 
@@ -1395,6 +1817,34 @@ defmodule Vix.Vips.Image do
     end
   end
 
+  @doc """
+  Get values of multiple image headers in a single call.
+
+  `names` is a list of header names, or `:all` to fetch every field
+  returned by `header_field_names/1`. Returns a map of name to value,
+  headers which do not exist are left out.
+
+  Prefer this over calling `header_value/2` for each header when more
+  than one value is needed.
+
+  ```elixir
+  {:ok, %{"width" => width, "height" => height}} =
+    Image.header_values(vips_image, ["width", "height", "icc-profile-data"])
+  ```
+  """
+  @doc since: "0.42.0"
+  @spec header_values(t(), [String.t()] | :all) :: {:ok, map()} | {:error, term()}
+  def header_values(%Image{ref: vips_image}, names) do
+    names = if names == :all, do: :all, else: Enum.map(names, &normalize_string/1)
+
+    with {:ok, values} <- Nif.nif_image_get_headers(vips_image, names) do
+      {:ok,
+       Map.new(values, fn {name, {type, value}} ->
+         {name, Vix.Type.to_erl_term(type, value)}
+       end)}
+    end
+  end
+
   @doc """
   Get image header value as string.
 
@@ -1472,7 +1922,7 @@ defmodule Vix.Vips.Image do
           format: Vix.Vips.Operation.vips_band_format() | nil
         }
   def headers(image) do
-    [
+    fields = [
       :width,
       :height,
       :bands,
@@ -1491,12 +1941,14 @@ defmodule Vix.Vips.Image do
       :coding,
       :format
     ]
-    |> Map.new(fn field ->
-      case header_value(image, to_string(field)) do
-        {:ok, value} -> {field, value}
-        {:error, _} -> {field, nil}
+
+    values =
+      case header_values(image, Enum.map(fields, &Atom.to_string/1)) do
+        {:ok, values} -> values
+        {:error, _} -> %{}
       end
-    end)
+
+    Map.new(fields, fn field -> {field, Map.get(values, Atom.to_string(field))} end)
   end
 
   @doc """
@@ -1533,7 +1985,7 @@ defmodule Vix.Vips.Image do
   defp to_double(nil, default), do: to_double(default)
   defp to_double(v, _default), do: to_double(v)
 
-  defp wrap_type({:ok, ref}), do: {:ok, %Image{ref: ref}}
+  defp wrap_type({:ok, ref}), do: {:ok, to_erl_term(ref)}
   defp wrap_type(value), do: value
 
   defp normalize_access_args(args) do
@@ -1886,11 +2338,32 @@ defmodule Vix.Vips.Image do
     end
   end
 
+  @cancel_options [:timeout, :owner]
+
+  defp saver_call(saver, args, opts) do
+    {cancel_opts, opts} = Keyword.split(opts, @cancel_options)
+    owner = Keyword.get(cancel_opts, :owner)
+
+    timeout =
+      case Keyword.get(cancel_opts, :timeout) do
+        :infinity -> nil
+        timeout -> timeout
+      end
+
+    if is_nil(owner) and is_nil(timeout) do
+      Operation.Helper.operation_call(saver, args, opts)
+    else
+      with {:ok, token} <- Nif.nif_cancel_token_new(owner, timeout) do
+        Operation.Helper.cancellable_operation_call(saver, args, opts, token)
+      end
+    end
+  end
+
   @spec init_write_stream(Image.t(), String.t(), keyword) :: term | no_return
   defp init_write_stream(image, suffix, opts) do
     with :ok <- validate_options(opts),
-         {:ok, pipe} <- Vix.TargetPipe.new(image, suffix, opts) do
-      pipe
+         {:ok, stream} <- Vix.TargetStream.new(image, suffix, opts) do
+      stream
     else
       {:error, reason} when is_binary(reason) ->
         raise Error, reason
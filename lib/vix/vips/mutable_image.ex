@@ -155,7 +155,7 @@ defmodule Vix.Vips.MutableImage do
 
   @impl true
   def init(image) do
-    case Image.copy_memory(image) do
+    case private_copy(image) do
       {:ok, copy} -> {:ok, %{image: copy}}
       {:error, error} -> {:stop, error}
     end
@@ -183,7 +183,7 @@ defmodule Vix.Vips.MutableImage do
 
   @impl true
   def handle_call(:to_image, _from, %{image: image} = state) do
-    {:reply, Image.copy_memory(image), state}
+    {:reply, private_copy(image), state}
   end
 
   @impl true
@@ -220,6 +220,16 @@ defmodule Vix.Vips.MutableImage do
     {:reply, {:ok, {width, height, bands}}, state}
   end
 
+  # `Image.copy_memory/1` returns images already in memory as they are,
+  # so the image drawn on would share its pixels with the caller's image
+  # and with any binary made from it. Always copy into a new buffer
+  defp private_copy(%Image{ref: ref}) do
+    case Nif.nif_image_copy_memory_private(ref) do
+      {:ok, ref} -> {:ok, Image.to_erl_term(ref)}
+      error -> error
+    end
+  end
+
   defp wrap_type({:ok, pid}), do: {:ok, %MutableImage{pid: pid}}
   defp wrap_type(value), do: value
 
@@ -11,10 +11,11 @@ defmodule Vix.Vips.MutableOperation do
 
   defp run_mutable_operation(name, %MutableImage{} = mutable_image, args, opts, spec) do
     %{in_req_spec: [_image_spec | args_spec]} = spec
+    {array_format, opts} = Helper.pop_array_format(opts)
     arg_terms = Helper.cast_arguments_to_nif_terms(args, opts, args_spec, spec.in_opt_spec)
 
     operation = fn image ->
-      Helper.mutable_operation_call(name, image, arg_terms, spec)
+      Helper.mutable_operation_call(name, image, arg_terms, spec, array_format)
     end
 
     MutableImage.run_operation(mutable_image, operation)
@@ -61,7 +62,7 @@ defmodule Vix.Vips.MutableOperation do
     #{prepare_doc(desc, in_req_spec, in_opt_spec, out_req_spec, out_opt_spec)}
     """
     @spec unquote(func_typespec(func_name, in_req_spec, in_opt_spec, out_req_spec, out_opt_spec))
-    if in_opt_spec == [] do
+    if not optional_args?(in_opt_spec, out_req_spec ++ out_opt_spec) do
       # operations without optional arguments
       def unquote(func_name)(unquote_splicing(req_params)) do
         [mutable_image | args] = unquote(req_params)
@@ -103,7 +104,7 @@ defmodule Vix.Vips.MutableOperation do
               out_opt_spec
             )
           )
-    if in_opt_spec == [] do
+    if not optional_args?(in_opt_spec, out_req_spec ++ out_opt_spec) do
       @dialyzer {:no_match, [{bang_func_name, length(req_params)}]}
       # operations without optional arguments
       def unquote(bang_func_name)(unquote_splicing(req_params)) do
@@ -73,6 +73,15 @@ defmodule Vix.Vips.Operation do
         "input-profile": "Adobe-RGB.icc"
       )
 
+  ### Array Results
+
+      # Integer and float arrays are returned as lists by default. With
+      # `array_format: :binary` they are returned as packed native-endian
+      # binaries, without building a term per element
+      {:ok, <<r::native-float-64, g::native-float-64, b::native-float-64>>} =
+        Operation.getpoint(image, 10, 10, array_format: :binary)
+
+
 
   > ## Performance Tips {: .tip}
   >
@@ -131,7 +140,7 @@ defmodule Vix.Vips.Operation do
     #{prepare_doc(desc, in_req_spec, in_opt_spec, out_req_spec, out_opt_spec)}
     """
     @spec unquote(func_typespec(func_name, in_req_spec, in_opt_spec, out_req_spec, out_opt_spec))
-    if in_opt_spec == [] do
+    if not optional_args?(in_opt_spec, out_req_spec ++ out_opt_spec) do
       # operations without optional arguments
       def unquote(func_name)(unquote_splicing(req_params)) do
         operation_call(unquote(name), unquote(req_params), [], unquote(Macro.escape(spec)))
@@ -157,7 +166,7 @@ defmodule Vix.Vips.Operation do
               out_opt_spec
             )
           )
-    if in_opt_spec == [] do
+    if not optional_args?(in_opt_spec, out_req_spec ++ out_opt_spec) do
       @dialyzer {:no_match, [{bang_func_name, length(req_params)}]}
       # operations without optional arguments
       def unquote(bang_func_name)(unquote_splicing(req_params)) do
@@ -16,17 +16,17 @@ defmodule Vix.Vips.Operation.Helper do
 
         {:ok, pspec} ->
           term = Type.to_nif_term(pspec.type, value, pspec.data)
-          [{name, term} | terms]
+          [{pspec.id, term} | terms]
       end
     end)
   end
 
   def vips_enum_list do
-    Nif.nif_vips_enum_list()
+    introspection().enums
   end
 
   def vips_flag_list do
-    Nif.nif_vips_flag_list()
+    introspection().flags
   end
 
   def vips_immutable_operation_list do
@@ -40,28 +40,31 @@ defmodule Vix.Vips.Operation.Helper do
   end
 
   def vips_operation_list do
-    Nif.nif_vips_operation_list()
-    |> Enum.uniq()
-    |> Enum.reject(&unsupported_operation?/1)
+    Enum.reject(introspection().operation_names, &unsupported_operation?/1)
   end
 
-  def output_to_erl_terms(nif_out_args, required_out_pspec, optional_out_pspec) do
+  def output_to_erl_terms(
+        nif_out_args,
+        required_out_pspec,
+        optional_out_pspec,
+        array_format \\ :list
+      ) do
     {required, optional} =
       nif_out_args
-      |> Enum.reduce({[], []}, fn {param, value}, {required, optional} ->
+      |> Enum.reduce({[], []}, fn {id, value}, {required, optional} ->
         cond do
-          Map.has_key?(required_out_pspec, param) ->
-            pspec = Map.get(required_out_pspec, param)
-            value = Type.to_erl_term(pspec.type, value)
+          Map.has_key?(required_out_pspec, id) ->
+            pspec = Map.get(required_out_pspec, id)
+            value = output_to_erl_term(pspec, value, array_format)
             {[{pspec.priority, value} | required], optional}
 
-          Map.has_key?(optional_out_pspec, param) ->
-            pspec = Map.get(optional_out_pspec, param)
-            value = Type.to_erl_term(pspec.type, value)
-            {required, [{String.to_atom(param), value} | optional]}
+          Map.has_key?(optional_out_pspec, id) ->
+            pspec = Map.get(optional_out_pspec, id)
+            value = output_to_erl_term(pspec, value, array_format)
+            {required, [{String.to_atom(pspec.param_name), value} | optional]}
 
           true ->
-            raise Error, message: "Invalid operation output field: #{param}"
+            raise Error, message: "Invalid operation output field: #{id}"
         end
       end)
 
@@ -86,6 +89,36 @@ defmodule Vix.Vips.Operation.Helper do
     end
   end
 
+  # int and double arrays are converted element by element to a list,
+  # unless the call asks for the packed native-endian binary with
+  # `array_format: :binary`
+  defp output_to_erl_term(%{type: {:vips_array, "Int"}}, value, :binary) do
+    Vix.Vips.Array.Int.to_binary(value)
+  end
+
+  defp output_to_erl_term(%{type: {:vips_array, "Double"}}, value, :binary) do
+    Vix.Vips.Array.Double.to_binary(value)
+  end
+
+  defp output_to_erl_term(pspec, value, _array_format) do
+    Type.to_erl_term(pspec.type, value)
+  end
+
+  def packed_array_output?(out_specs) do
+    Enum.any?(out_specs, &(&1.type in [{:vips_array, "Int"}, {:vips_array, "Double"}]))
+  end
+
+  def pop_array_format(opts) do
+    case Keyword.pop(opts, :array_format, :list) do
+      {format, opts} when format in [:list, :binary] ->
+        {format, opts}
+
+      {format, _opts} ->
+        raise ArgumentError,
+              "expected array_format to be :list or :binary, given: #{inspect(format)}"
+    end
+  end
+
   def prepare_doc(desc, required_in, optional_in, required_out, optional_out) do
     """
     #{String.capitalize(to_string(desc))}
@@ -93,7 +126,7 @@ defmodule Vix.Vips.Operation.Helper do
     ## Arguments
     #{required_in_doc(required_in)}
 
-    #{optional_in_doc(optional_in)}
+    #{optional_in_doc(optional_in, packed_array_output?(required_out ++ optional_out))}
 
     #{output_values_doc(required_out, optional_out)}
     """
@@ -146,6 +179,22 @@ defmodule Vix.Vips.Operation.Helper do
     }
   end
 
+  # operation spec is built from introspection, which does not change
+  # for the lifetime of the VM
+  def cached_operation_args_spec(name) do
+    key = {__MODULE__, name}
+
+    case :persistent_term.get(key, nil) do
+      nil ->
+        spec = operation_args_spec(name)
+        :persistent_term.put(key, spec)
+        spec
+
+      spec ->
+        spec
+    end
+  end
+
   def function_name(name), do: to_string(name) |> String.downcase() |> String.to_atom()
 
   def normalize_input_variable_names(specs) do
@@ -232,11 +281,7 @@ defmodule Vix.Vips.Operation.Helper do
     quote do
       unquote(func_name)(
         unquote_splicing(
-          if optional_in == [] do
-            required_args_typespec(required_in)
-          else
-            required_args_typespec(required_in) ++ [optional_args_typespec(optional_in)]
-          end
+          input_args_typespec(required_in, optional_in, required_out ++ optional_out)
         )
       ) ::
         unquote(output_typespec(required_out, optional_out))
@@ -247,39 +292,78 @@ defmodule Vix.Vips.Operation.Helper do
     quote do
       unquote(func_name)(
         unquote_splicing(
-          if optional_in == [] do
-            required_args_typespec(required_in)
-          else
-            required_args_typespec(required_in) ++ [optional_args_typespec(optional_in)]
-          end
+          input_args_typespec(required_in, optional_in, required_out ++ optional_out)
         )
       ) ::
         unquote(bang_output_typespec(required_out, optional_out))
     end
   end
 
+  # whether the function takes a keyword list of optional arguments
+  def optional_args?(optional_in, out_specs) do
+    optional_in != [] or packed_array_output?(out_specs)
+  end
+
+  defp input_args_typespec(required_in, optional_in, out_specs) do
+    optional =
+      if packed_array_output?(out_specs) do
+        optional_args_typespec(optional_in) ++ [array_format: quote(do: :list | :binary)]
+      else
+        optional_args_typespec(optional_in)
+      end
+
+    if optional_args?(optional_in, out_specs) do
+      required_args_typespec(required_in) ++ [optional]
+    else
+      required_args_typespec(required_in)
+    end
+  end
+
   def operation_call(name, args, opts) do
     operation_call(name, args, opts, operation_args_spec(name))
   end
 
   def operation_call(name, args, opts, %{desc: _} = spec) do
+    {array_format, opts} = pop_array_format(opts)
     nif_args = cast_arguments_to_nif_terms(args, opts, spec.in_req_spec, spec.in_opt_spec)
-    nif_operation_call(name, nif_args, spec)
+    nif_operation_call(name, nif_args, spec, array_format)
   end
 
-  def mutable_operation_call(name, image, arg_terms, %{in_req_spec: [image_spec | _]} = spec) do
+  def cancellable_operation_call(name, args, opts, cancel_token) do
+    spec = cached_operation_args_spec(name)
+    nif_args = cast_arguments_to_nif_terms(args, opts, spec.in_req_spec, spec.in_opt_spec)
+
+    name
+    |> Vix.Nif.nif_vips_operation_call(nif_args, cancel_token)
+    |> nif_result_to_erl_terms(spec)
+  end
+
+  def mutable_operation_call(
+        name,
+        image,
+        arg_terms,
+        %{in_req_spec: [image_spec | _]} = spec,
+        array_format
+      ) do
     image_term = Type.to_nif_term(image_spec.type, image, image_spec.data)
-    nif_args = [{image_spec.param_name, image_term} | arg_terms]
-    nif_operation_call(name, nif_args, spec)
+    nif_args = [{image_spec.id, image_term} | arg_terms]
+    nif_operation_call(name, nif_args, spec, array_format)
+  end
+
+  defp nif_operation_call(name, nif_args, spec, array_format) do
+    name
+    |> Vix.Nif.nif_vips_operation_call(nif_args)
+    |> nif_result_to_erl_terms(spec, array_format)
   end
 
-  defp nif_operation_call(name, nif_args, spec) do
-    case Vix.Nif.nif_vips_operation_call(name, nif_args) do
+  def nif_result_to_erl_terms(result, spec, array_format \\ :list) do
+    case result do
       {:ok, nif_out_args} ->
         output_to_erl_terms(
           nif_out_args,
-          Map.new(spec.out_req_spec, &{&1.param_name, &1}),
-          Map.new(spec.out_opt_spec, &{&1.param_name, &1})
+          Map.new(spec.out_req_spec, &{&1.id, &1}),
+          Map.new(spec.out_opt_spec, &{&1.id, &1}),
+          array_format
         )
 
       {:error, {label, error}} ->
@@ -329,13 +413,53 @@ defmodule Vix.Vips.Operation.Helper do
   end
 
   defp vips_operation_arguments(name) do
-    {description, args} = Nif.nif_vips_operation_get_arguments(name)
+    case Map.fetch(introspection().operations, name) do
+      {:ok, operation} ->
+        operation
+
+      # deprecated operations are not part of the bulk introspection
+      :error ->
+        name
+        |> Nif.nif_vips_operation_get_arguments()
+        |> parse_operation_arguments()
+    end
+  end
 
+  # Specs of all operations, enums and flags are fetched in a single
+  # call and kept for the lifetime of the VM. Both the code generation at
+  # compile time and the runtime lookups use it.
+  defp introspection do
+    key = {__MODULE__, :introspection}
+
+    case :persistent_term.get(key, nil) do
+      nil ->
+        {operations, enums, flags} = Nif.nif_vips_introspect()
+
+        introspection = %{
+          operation_names: operations |> Enum.map(&elem(&1, 0)) |> Enum.uniq(),
+          operations:
+            Map.new(operations, fn {name, arguments} ->
+              {name, parse_operation_arguments(arguments)}
+            end),
+          enums: enums,
+          flags: flags
+        }
+
+        :persistent_term.put(key, introspection)
+        introspection
+
+      introspection ->
+        introspection
+    end
+  end
+
+  defp parse_operation_arguments({description, args}) do
     args =
-      Enum.map(args, fn {name, spec_details, priority, flags} ->
+      Enum.map(args, fn {id, name, spec_details, priority, flags} ->
         {desc, spec_type, value_type, data} = spec_details
 
         GParamSpec.new(%{
+          id: id,
           name: name,
           desc: desc,
           spec_type: spec_type,
@@ -360,13 +484,25 @@ defmodule Vix.Vips.Operation.Helper do
     end
   end
 
-  defp optional_in_doc([]), do: ""
+  defp optional_in_doc([], false), do: ""
+
+  defp optional_in_doc(optional_in, packed_array_output?) do
+    array_format_doc =
+      if packed_array_output? do
+        [
+          "* array_format - Return integer and float arrays as a list, or as a packed " <>
+            "native-endian binary with `:binary`. Default: `:list`"
+        ]
+      else
+        []
+      end
 
-  defp optional_in_doc(optional_in) do
     optional_args =
-      Enum.map_join(optional_in, "\n", fn pspec ->
+      Enum.map(optional_in, fn pspec ->
         "* #{pspec.param_name} - #{pspec.desc}. #{default(pspec)}"
       end)
+      |> Enum.concat(array_format_doc)
+      |> Enum.join("\n")
 
     """
     ## Optional
@@ -0,0 +1,203 @@
+defmodule Vix.Vips.Pipeline do
+  @moduledoc """
+  Build a graph of operations and run it in a single native call.
+
+  Every function in `Vix.Vips.Operation` is a separate NIF call which
+  creates the operation, marshals the arguments and wraps each output
+  in a new resource. For a chain of small operations that overhead can
+  be larger than the work itself. A pipeline collects the operations
+  first and then builds all of them natively at once, returning only
+  the outputs you ask for. Intermediate images never cross the NIF
+  boundary.
+
+  Operations are added with `add/4` which takes the same arguments as
+  the matching `Vix.Vips.Operation` function and returns a reference to
+  the output of the node. References can be passed as arguments to
+  later nodes, and as outputs to `run/2`.
+
+  ## Example
+
+      alias Vix.Vips.Pipeline
+
+      {:ok, image} = Vix.Vips.Image.new_from_file("input.jpg")
+
+      pipeline = Pipeline.new()
+      {pipeline, thumb} = Pipeline.add(pipeline, :thumbnail_image, [image, 300])
+      {pipeline, sharp} = Pipeline.add(pipeline, :sharpen, [thumb], sigma: 1.0)
+      {pipeline, jpeg} = Pipeline.add(pipeline, :jpegsave_buffer, [sharp], Q: 80)
+
+      {:ok, binary} = Pipeline.run(pipeline, jpeg)
+
+  Operations which modify their input in place (such as `draw_circle`)
+  are not supported, use `Vix.Vips.MutableImage` for those.
+  References can only be used where the node output type matches the
+  argument type, they can not be used as an element of a list
+  argument.
+  """
+
+  alias Vix.Type
+  alias Vix.Vips.Operation.Helper
+  alias __MODULE__
+
+  defmodule Ref do
+    @moduledoc """
+    Reference to an output of a pipeline node.
+    """
+
+    @type t() :: %__MODULE__{node: non_neg_integer(), output: String.t() | nil}
+
+    defstruct [:node, :output]
+  end
+
+  @type t() :: %Pipeline{nodes: list(), count: non_neg_integer()}
+
+  defstruct nodes: [], count: 0
+
+  @doc """
+  Returns an empty pipeline.
+  """
+  @spec new() :: t()
+  def new, do: %Pipeline{}
+
+  @doc """
+  Adds an operation to the pipeline.
+
+  `args` are the required arguments and `opts` are the optional
+  arguments of the operation, same as the matching
+  `Vix.Vips.Operation` function. Any of them can be a `Ref` to an
+  output of a previously added node.
+
+  Returns the updated pipeline and a reference to the first required
+  output of the node. Use `output/2` to refer to other outputs.
+  """
+  @spec add(t(), atom() | String.t(), [term()], keyword()) :: {t(), Ref.t()}
+  def add(%Pipeline{} = pipeline, operation, args, opts \\ []) when is_list(args) do
+    name = to_string(operation)
+    spec = Helper.cached_operation_args_spec(name)
+
+    if Enum.any?(spec.in_req_spec, &(&1.type == "MutableVipsImage")) do
+      raise ArgumentError, "mutable operation #{name} can not be used in a pipeline"
+    end
+
+    nif_args = cast_arguments(pipeline, name, args, opts, spec)
+
+    ref =
+      case spec.out_req_spec do
+        [pspec | _] -> %Ref{node: pipeline.count, output: pspec.param_name}
+        [] -> %Ref{node: pipeline.count, output: nil}
+      end
+
+    pipeline = %Pipeline{
+      pipeline
+      | nodes: [{name, nif_args, spec} | pipeline.nodes],
+        count: pipeline.count + 1
+    }
+
+    {pipeline, ref}
+  end
+
+  @doc """
+  Returns a reference to the output `name` of the node referenced by `ref`.
+
+  ```elixir
+  {pipeline, ref} = Pipeline.add(pipeline, :find_trim, [image])
+  width = Pipeline.output(ref, :width)
+  ```
+  """
+  @spec output(Ref.t(), atom() | String.t()) :: Ref.t()
+  def output(%Ref{} = ref, name), do: %Ref{ref | output: to_string(name)}
+
+  @doc """
+  Builds and evaluates every node of the pipeline in one native call.
+
+  `outputs` is either a single reference or a list of references. The
+  result has the same shape.
+  """
+  @spec run(t(), Ref.t() | [Ref.t()]) :: {:ok, term() | [term()]} | {:error, term()}
+  def run(%Pipeline{} = pipeline, %Ref{} = output) do
+    case run(pipeline, [output]) do
+      {:ok, [value]} -> {:ok, value}
+      error -> error
+    end
+  end
+
+  def run(%Pipeline{count: 0}, _outputs) do
+    {:error, "pipeline is empty"}
+  end
+
+  def run(%Pipeline{} = pipeline, outputs) when is_list(outputs) do
+    nodes = Enum.reverse(pipeline.nodes)
+    specs = nodes |> Enum.map(&elem(&1, 2)) |> List.to_tuple()
+
+    output_specs = Enum.map(outputs, &output_pspec(specs, &1))
+    nif_nodes = Enum.map(nodes, fn {name, nif_args, _spec} -> {name, nif_args} end)
+    nif_outputs = Enum.map(outputs, &{&1.node, &1.output})
+
+    case Vix.Nif.nif_vips_pipeline_run(nif_nodes, nif_outputs) do
+      {:ok, values} ->
+        values =
+          Enum.zip_with(output_specs, values, fn pspec, value ->
+            Type.to_erl_term(pspec.type, value)
+          end)
+
+        {:ok, values}
+
+      {:error, {label, error}} ->
+        {:error, String.trim("#{label}: #{error}")}
+
+      {:error, term} ->
+        {:error, term}
+    end
+  end
+
+  defp cast_arguments(_pipeline, name, args, _opts, spec)
+       when length(args) != length(spec.in_req_spec) do
+    raise ArgumentError,
+          "#{name} expects #{length(spec.in_req_spec)} required arguments, got #{length(args)}"
+  end
+
+  defp cast_arguments(pipeline, _name, args, opts, spec) do
+    args_values =
+      Enum.zip_with(spec.in_req_spec, args, fn pspec, value ->
+        {pspec.param_name, value}
+      end)
+
+    opt_values = Enum.map(opts, fn {name, value} -> {Atom.to_string(name), value} end)
+    all_args_spec = Map.new(spec.in_req_spec ++ spec.in_opt_spec, &{&1.param_name, &1})
+
+    Enum.flat_map(args_values ++ opt_values, fn {name, value} ->
+      case Map.fetch(all_args_spec, name) do
+        # skip unsupported additional arguments, same as regular calls
+        :error ->
+          []
+
+        {:ok, pspec} when is_struct(value, Ref) ->
+          [{pspec.id, ref_to_nif_term(pipeline, value)}]
+
+        {:ok, pspec} ->
+          [{pspec.id, Type.to_nif_term(pspec.type, value, pspec.data)}]
+      end
+    end)
+  end
+
+  defp ref_to_nif_term(%Pipeline{count: count}, %Ref{node: node, output: output})
+       when node < count and is_binary(output) do
+    {node, output}
+  end
+
+  defp ref_to_nif_term(_pipeline, ref) do
+    raise ArgumentError, "invalid pipeline reference: #{inspect(ref)}"
+  end
+
+  defp output_pspec(specs, %Ref{node: node, output: output} = ref)
+       when node < tuple_size(specs) do
+    spec = elem(specs, node)
+
+    Enum.find(spec.out_req_spec ++ spec.out_opt_spec, &(&1.param_name == output)) ||
+      raise ArgumentError, "invalid pipeline output: #{inspect(ref)}"
+  end
+
+  defp output_pspec(_specs, ref) do
+    raise ArgumentError, "invalid pipeline output: #{inspect(ref)}"
+  end
+end
@@ -0,0 +1,120 @@
+defmodule Vix.Vips.SeekableSource do
+  @moduledoc """
+  Behaviour for loading images from random access storage.
+
+  `Vix.Vips.Image.new_from_enum/2` can only read the input front to
+  back, so loaders which need random access, such as TIFF or HEIF,
+  make libvips buffer the whole input in memory. A seekable source
+  instead serves each read at an arbitrary offset, so only the parts
+  used by the loader are fetched. For example, only the directories
+  and tiles of the pages being accessed are read from a large
+  multi-page TIFF.
+
+  A backend implements the callbacks below and is passed to
+  `Vix.Vips.Image.new_from_seekable_source/2` as `{module, args}`.
+  It runs in a process of its own, started when the image is loaded
+  and stopped once the image is released.
+
+  ```elixir
+  defmodule RangeSource do
+    @behaviour Vix.Vips.SeekableSource
+
+    @impl true
+    def init(url), do: {:ok, url}
+
+    @impl true
+    def size(url), do: {:ok, fetch_content_length(url)}
+
+    @impl true
+    def read_at(url, offset, length), do: {:ok, fetch_range(url, offset, length)}
+  end
+
+  {:ok, image} = Image.new_from_seekable_source({RangeSource, url})
+  ```
+
+  `Vix.Vips.SeekableSource.File` reads a local file.
+  """
+
+  alias Vix.Nif
+
+  @type state :: term
+
+  @doc """
+  Initializes the backend in the process serving the reads.
+  """
+  @callback init(args :: term) :: {:ok, state} | {:error, term}
+
+  @doc """
+  Returns the total size of the input in bytes.
+
+  Returning `{:ok, nil}` is allowed when the size is unknown, loaders
+  which need to seek from the end of the input will fail.
+  """
+  @callback size(state) :: {:ok, non_neg_integer | nil} | {:error, term}
+
+  @doc """
+  Reads up to `length` bytes starting at `offset`.
+
+  Returning fewer bytes than requested is allowed. `:eof` must be
+  returned when `offset` is at or past the end of the input.
+  """
+  @callback read_at(state, offset :: non_neg_integer, length :: pos_integer) ::
+              {:ok, iodata} | :eof | {:error, term}
+
+  @doc """
+  Releases the resources held by the backend.
+  """
+  @callback close(state) :: :ok
+
+  @optional_callbacks close: 1
+
+  @doc false
+  @spec start({module, term}) :: {:ok, Vix.Vips.Source.t()} | {:error, term}
+  def start({module, args}) when is_atom(module) do
+    parent = self()
+    {pid, monitor} = spawn_monitor(fn -> init(parent, module, args) end)
+
+    receive do
+      {^pid, result} ->
+        Process.demonitor(monitor, [:flush])
+        result
+
+      {:DOWN, ^monitor, :process, ^pid, reason} ->
+        {:error, reason}
+    end
+  end
+
+  defp init(parent, module, args) do
+    with {:ok, state} <- module.init(args),
+         {:ok, size} <- module.size(state),
+         {:ok, {stream, ref, source}} <- Nif.nif_seekable_source_new(size || -1) do
+      send(parent, {self(), {:ok, %Vix.Vips.Source{ref: source}}})
+      loop(stream, ref, module, state)
+    else
+      error -> send(parent, {self(), error})
+    end
+  end
+
+  defp loop(stream, ref, module, state) do
+    receive do
+      {^ref, :read, id, offset, length} ->
+        :ok = Nif.nif_seekable_source_reply(stream, id, read(module, state, offset, length))
+        loop(stream, ref, module, state)
+
+      {^ref, :close} ->
+        if function_exported?(module, :close, 1) do
+          module.close(state)
+        end
+
+        :ok
+    end
+  end
+
+  defp read(module, state, offset, length) do
+    case module.read_at(state, offset, length) do
+      {:ok, iodata} -> iodata
+      :eof -> :eof
+      {:error, reason} -> {:error, reason}
+    end
+  end
+end
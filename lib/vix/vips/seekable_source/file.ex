@@ -0,0 +1,31 @@
+defmodule Vix.Vips.SeekableSource.File do
+  @moduledoc """
+  `Vix.Vips.SeekableSource` reading a local file.
+
+  ```elixir
+  {:ok, image} = Image.new_from_seekable_source({Vix.Vips.SeekableSource.File, "large.tif"})
+  ```
+  """
+
+  @behaviour Vix.Vips.SeekableSource
+
+  @impl true
+  def init(path) do
+    :file.open(path, [:read, :raw, :binary])
+  end
+
+  @impl true
+  def size(fd) do
+    :file.position(fd, :eof)
+  end
+
+  @impl true
+  def read_at(fd, offset, length) do
+    :file.pread(fd, offset, length)
+  end
+
+  @impl true
+  def close(fd) do
+    :file.close(fd)
+  end
+end
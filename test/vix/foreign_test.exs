@@ -3,11 +3,32 @@ defmodule Vix.Vips.ForeignTest do
   alias Vix.Vips.Foreign
   import Vix.Support.Images
 
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   test "find_load_buffer" do
     path = img_path("puppies.jpg")
     assert {:ok, "VipsForeignLoadJpegBuffer"} = Foreign.find_load_buffer(File.read!(path))
   end
 
+  test "find_load_buffer for other formats" do
+    assert {:ok, "VipsForeignLoadPngBuffer"} =
+             Foreign.find_load_buffer(File.read!(img_path("gradient.png")))
+
+    assert {:ok, "VipsForeignLoadTiffBuffer"} =
+             Foreign.find_load_buffer(File.read!(img_path("boats.tif")))
+  end
+
+  test "find_load_buffer with unknown or partial signatures" do
+    assert {:error, "Failed to find load buffer"} = Foreign.find_load_buffer("not an image")
+
+    # RIFF container which is not WebP
+    assert {:error, "Failed to find load buffer"} =
+             Foreign.find_load_buffer("RIFF" <> <<0, 0, 0, 0>> <> "WAVEfmt ")
+
+    assert {:error, "Failed to find load buffer"} = Foreign.find_load_buffer(<<0xFF, 0xD8>>)
+  end
+
   test "find_save_buffer" do
     assert {:ok, "VipsForeignSaveJpegBuffer"} = Foreign.find_save_buffer("puppies.jpg")
   end
@@ -24,11 +45,11 @@ defmodule Vix.Vips.ForeignTest do
   test "find_load_source" do
     bin = File.read!(img_path("puppies.jpg"))
 
-    assert {pipe, source} = Vix.SourcePipe.new()
-    assert :ok = Vix.SourcePipe.write(pipe, bin)
-    assert :ok = Vix.SourcePipe.stop(pipe)
+    assert {:ok, stream} = Vix.SourceStream.new()
+    assert :ok = Vix.SourceStream.write(stream, bin)
+    assert :ok = Vix.SourceStream.finish(stream)
 
-    assert {:ok, "VipsForeignLoadJpegSource"} = Foreign.find_load_source(source)
+    assert {:ok, "VipsForeignLoadJpegSource"} = Foreign.find_load_source(stream.source)
   end
 
   test "find_save_target" do
@@ -36,4 +57,46 @@ defmodule Vix.Vips.ForeignTest do
     assert {:error, "Failed to find saver for the target"} = Foreign.find_save_target(".pdf")
     assert {:error, "Failed to find saver for the target"} = Foreign.find_save_target(".tiff")
   end
+
+  describe "saver table" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "matches the libvips search for every suffix" do
+      assert {:ok, savers} = Foreign.get_savers()
+      assert {:ok, suffixes} = Foreign.get_suffixes()
+
+      assert Map.has_key?(savers.file, ".jpg")
+
+      for suffix <- suffixes do
+        assert Map.fetch(savers.file, suffix) ==
+                 ok_or_error(Vix.Nif.nif_foreign_find_save(suffix))
+
+        assert Map.fetch(savers.buffer, suffix) ==
+                 ok_or_error(Vix.Nif.nif_foreign_find_save_buffer(suffix))
+
+        assert Map.fetch(savers.target, suffix) ==
+                 ok_or_error(Vix.Nif.nif_foreign_find_save_target(suffix))
+      end
+    end
+
+    test "suffixes are listed once" do
+      assert {:ok, suffixes} = Foreign.get_suffixes()
+      assert suffixes == Enum.uniq(suffixes)
+
+      assert {:ok, suffixes} = Foreign.get_loader_suffixes()
+      assert suffixes == Enum.uniq(suffixes)
+    end
+
+    test "lookup ignores case and falls back for names it does not know" do
+      assert {:ok, "VipsForeignSaveJpegFile"} = Foreign.find_save("/tmp/PUPPIES.JPG")
+      assert {:ok, "VipsForeignSaveJpegBuffer"} = Foreign.find_save_buffer(".jpg")
+      assert {:ok, "VipsForeignSavePngFile"} = Foreign.find_save("out.png[compression=9]")
+      assert {:error, "Failed to find save"} = Foreign.find_save("out.unknown")
+    end
+  end
+
+  defp ok_or_error({:ok, name}), do: {:ok, name}
+  defp ok_or_error({:error, _}), do: :error
 end
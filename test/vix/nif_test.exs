@@ -28,6 +28,21 @@ defmodule Vix.NifTest do
     @tag skip: "requires NIF compiled from current source"
   end
 
+  test "nif_vips_introspect" do
+    assert {operations, enums, flags} = Nif.nif_vips_introspect()
+
+    operations = Map.new(operations)
+    assert Map.keys(operations) -- Nif.nif_vips_operation_list() == []
+    assert operations["invert"] == Nif.nif_vips_operation_get_arguments("invert")
+
+    assert Enum.sort(enums) == Enum.sort(Nif.nif_vips_enum_list())
+    assert Enum.sort(flags) == Enum.sort(Nif.nif_vips_flag_list())
+  end
+
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
   test "nif_read accepts large read sizes within the limit" do
     {:ok, {read_fd, raw_write_fd}} = Nif.nif_pipe_open(:read)
 
@@ -49,6 +64,24 @@ defmodule Vix.NifTest do
     end)
   end
 
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "nif_source_stream_write queues nothing from an invalid list" do
+    {:ok, {stream, _ref, source}} = Nif.nif_source_stream_new(64 * 1024 * 1024)
+
+    # longer than the slices the list is enqueued in
+    invalid = List.duplicate("junk", 100) ++ [:not_binary]
+    assert {:error, _} = Nif.nif_source_stream_write(stream, invalid)
+
+    assert :ok = Nif.nif_source_stream_write(stream, [File.read!(img_path("puppies.jpg"))])
+    assert :ok = Nif.nif_source_stream_finish(stream)
+
+    assert {:ok, im} = Nif.nif_image_new_from_source(source, "")
+    assert {:ok, _} = Nif.nif_image_write_to_binary(im)
+  end
+
   test "read fd closes at OS level when owner exits with pending select" do
     {owner, raw_write_fd} = owner_with_pending_select(:read)
 
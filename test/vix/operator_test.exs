@@ -9,6 +9,11 @@ defmodule Vix.OperatorTest do
 
   doctest Vix.Operator
 
+  require Vix.Operator
+
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   describe "+/2" do
     test "when both arguments are image" do
       black = Operation.black!(10, 10, bands: 3)
@@ -201,4 +206,59 @@ defmodule Vix.OperatorTest do
       assert 3 ** 2 == 9
     end
   end
+
+  describe "fuse/1" do
+    test "folds constant arithmetic into a single linear" do
+      img = Operation.black!(10, 10, bands: 3)
+
+      assert {:linear, ^img, [2.0, 4.0, 2.0], [5.0, 9.0, 5.0]} =
+               Vix.Operator.Fusion.op(
+                 :-,
+                 Vix.Operator.Fusion.op(:+, Vix.Operator.Fusion.op(:*, img, [1, 2, 1]), 10),
+                 5
+               )
+               |> then(&Vix.Operator.Fusion.op(:*, &1, 2))
+               |> then(&Vix.Operator.Fusion.op(:-, &1, [5, 1, 5]))
+    end
+
+    test "when no argument is an image" do
+      assert Vix.Operator.fuse(1 + 2 * 3) == 7
+      assert Vix.Operator.fuse(1 < 2) == true
+    end
+
+    if @precompiled_nif_mode do
+      @tag skip: "requires NIF compiled from current source"
+    end
+
+    test "matches the eager operators" do
+      # values are powers of two so that folded constants are exact
+      img = Operation.black!(10, 10, bands: 3) + [2, 4, 8]
+      other = Operation.black!(10, 10, bands: 3) + 4
+
+      assert_images_equal(Vix.Operator.fuse(img * 2 + 10 - 5), img * 2 + 10 - 5)
+      assert_images_equal(Vix.Operator.fuse((img * 2 + 10) > 20), (img * 2 + 10) > 20)
+      assert_images_equal(Vix.Operator.fuse(img / other + [1, 2, 3]), img / other + [1, 2, 3])
+      assert_images_equal(Vix.Operator.fuse([40, 40, 40] / img * 3), [40, 40, 40] / img * 3)
+      assert_images_equal(Vix.Operator.fuse((img + other) ** 2 == 64), (img + other) ** 2 == 64)
+    end
+
+    if @precompiled_nif_mode do
+      @tag skip: "requires NIF compiled from current source"
+    end
+
+    test "operators nested in other calls are fused too" do
+      img = Operation.black!(10, 10, bands: 3) + 10
+
+      out = Vix.Operator.fuse(Operation.invert!(img * 2 + 1) + 1)
+
+      assert_images_equal(out, Operation.invert!(img * 2 + 1) + 1)
+    end
+
+    test "when argument is invalid" do
+      img = Operation.black!(10, 10, bands: 3)
+
+      assert_raise ArgumentError, fn -> Vix.Operator.fuse(img + [1, :a]) end
+      assert_raise ArgumentError, fn -> Vix.Operator.fuse(img + "a") end
+    end
+  end
 end
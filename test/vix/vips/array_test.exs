@@ -3,6 +3,9 @@ defmodule Vix.Vips.ArrayTest do
 
   alias Vix.Vips.Array
 
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   describe "Int" do
     test "to_nif_term" do
       obj = Array.Int.to_nif_term([1, 2, 3, 4], nil)
@@ -15,6 +18,26 @@ defmodule Vix.Vips.ArrayTest do
       obj = Array.Int.to_nif_term([1, 2, 3, 4], nil)
       assert [1, 2, 3, 4] == Array.Int.to_erl_term(obj)
     end
+
+    if @precompiled_nif_mode do
+      @tag skip: "requires NIF compiled from current source"
+    end
+
+    test "binary round trip" do
+      bin = for i <- [1, -2, 3, 1_000_000], into: <<>>, do: <<i::native-signed-32>>
+      obj = Array.Int.to_nif_term(bin, nil)
+
+      assert [1, -2, 3, 1_000_000] == Array.Int.to_erl_term(obj)
+      assert bin == Array.Int.to_binary(Array.Int.to_nif_term([1, -2, 3, 1_000_000], nil))
+    end
+
+    if @precompiled_nif_mode do
+      @tag skip: "requires NIF compiled from current source"
+    end
+
+    test "binary with a partial element" do
+      assert_raise ArgumentError, fn -> Array.Int.to_nif_term(<<1, 2, 3>>, nil) end
+    end
   end
 
   describe "Double" do
@@ -30,6 +53,23 @@ defmodule Vix.Vips.ArrayTest do
       # values are casted to double
       assert [1.0, 2.46, 0.2, 400.00001] == Array.Double.to_erl_term(obj)
     end
+
+    if @precompiled_nif_mode do
+      @tag skip: "requires NIF compiled from current source"
+    end
+
+    test "binary round trip" do
+      values = [1.0, 2.46, -0.2, 400.00001]
+      bin = for v <- values, into: <<>>, do: <<v::native-float-64>>
+
+      # sub-binaries at an odd offset are accepted too
+      <<_, unaligned::binary>> = <<0>> <> bin
+      obj = Array.Double.to_nif_term(unaligned, nil)
+
+      assert values == Array.Double.to_erl_term(obj)
+      assert bin == Array.Double.to_binary(obj)
+      assert <<>> == Array.Double.to_binary(Array.Double.to_nif_term(<<>>, nil))
+    end
   end
 
   describe "Enum.VipsInterpretation" do
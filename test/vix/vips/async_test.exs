@@ -0,0 +1,78 @@
+defmodule Vix.Vips.AsyncTest do
+  use ExUnit.Case, async: true
+
+  alias Vix.Vips.Async
+  alias Vix.Vips.Image
+  alias Vix.Vips.Operation
+
+  import Vix.Support.Images
+
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
+  if @precompiled_nif_mode do
+    @moduletag skip: "requires NIF compiled from current source"
+  end
+
+  test "await returns the same result as a regular call" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, %Image{} = out} =
+             :invert
+             |> Async.call([im])
+             |> Async.await()
+
+    assert_images_equal(out, Operation.invert!(im))
+  end
+
+  test "multiple calls run concurrently" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    results =
+      [100, 200, 300]
+      |> Enum.map(&Async.call(:thumbnail_image, [im, &1]))
+      |> Enum.map(&Async.await(&1, 10_000))
+
+    assert [100, 200, 300] == Enum.map(results, fn {:ok, out} -> Image.width(out) end)
+  end
+
+  test "array outputs as packed binaries" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, bin} =
+             :getpoint
+             |> Async.call([im, 10, 10], array_format: :binary)
+             |> Async.await()
+
+    assert {:ok, bin} == Operation.getpoint(im, 10, 10, array_format: :binary)
+  end
+
+  test "await returns optional outputs" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, {value, %{x: x, y: y}}} =
+             :max
+             |> Async.call([im], size: 1)
+             |> Async.await()
+
+    assert is_float(value)
+    assert is_integer(x) and is_integer(y)
+  end
+
+  test "await returns operation error" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:error, "operation build: " <> _} =
+             :extract_area
+             |> Async.call([im, 0, 0, 100_000, 10])
+             |> Async.await()
+  end
+
+  test "reply can be received manually" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+    %Async{ref: ref} = async = Async.call(:invert, [im])
+
+    assert_receive {^ref, reply}, 5000
+    assert {:ok, %Image{}} = Async.result(async, reply)
+  end
+end
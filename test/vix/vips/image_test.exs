@@ -3,11 +3,15 @@ defmodule Vix.Vips.ImageTest do
 
   alias Vix.Vips.Image
   alias Vix.Vips.MutableImage
+  alias Vix.Vips.Operation
 
   import Vix.Support.Images
 
   doctest Image
 
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   test "new_from_file" do
     assert {:error, :invalid_path} == Image.new_from_file("invalid.jpg", [])
     assert {:error, "Failed to find load"} == Image.new_from_file(__ENV__.file, [])
@@ -123,6 +127,24 @@ defmodule Vix.Vips.ImageTest do
             >>} = Image.write_to_binary(img)
   end
 
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "new_matrix_from_binary" do
+    bin = <<-1::native-float, -1::native-float, 0::native-float, 16::native-float>>
+
+    assert {:ok, img} = Image.new_matrix_from_binary(2, 2, bin, scale: 2, offset: 1)
+    assert %{width: 2, height: 2, bands: 1} = Image.headers(img)
+    assert Image.format(img) == :VIPS_FORMAT_DOUBLE
+    assert Image.header_value(img, "scale") == {:ok, 2.0}
+    assert Image.header_value(img, "offset") == {:ok, 1.0}
+
+    assert {:ok, ^bin} = Image.write_to_binary(img)
+
+    assert {:error, _} = Image.new_matrix_from_binary(2, 3, bin)
+  end
+
   describe "new_from_list" do
     test "when argument is range" do
       assert {:ok, img} = Image.new_from_list(0..2)
@@ -233,6 +255,130 @@ defmodule Vix.Vips.ImageTest do
            } = Image.headers(im)
   end
 
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "header_values" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, values} =
+             Image.header_values(im, ["width", "format", "interpretation", "xres", "invalid"])
+
+    assert values == %{
+             "width" => 518,
+             "format" => :VIPS_FORMAT_UCHAR,
+             "interpretation" => :VIPS_INTERPRETATION_sRGB,
+             "xres" => 2.834645669291339
+           }
+
+    assert {:ok, all} = Image.header_values(im, :all)
+    {:ok, fields} = Image.header_field_names(im)
+    assert Map.keys(all) -- fields == []
+    assert all["height"] == 389
+    assert <<_::binary>> = all["exif-data"]
+  end
+
+  describe "write_areas_to_binary" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "returns the same pixels as extracting each area" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      areas = [
+        [left: 0, top: 0, width: 50, height: 40],
+        [left: 10, top: 20, width: 50, height: 40, band_start: 1, band_count: 2],
+        [left: 400, top: 300, width: 100, height: 80, band_start: 2, band_count: 1],
+        [left: 0, top: 0, width: 1, height: 1]
+      ]
+
+      assert {:ok, results} = Image.write_areas_to_binary(im, areas)
+      assert length(results) == length(areas)
+
+      Enum.zip_with(areas, results, fn area, result ->
+        expected =
+          im
+          |> Operation.extract_area!(area[:left], area[:top], area[:width], area[:height])
+          |> Operation.extract_band!(area[:band_start] || 0, n: area[:band_count] || 3)
+
+        assert {:ok, binary} = Image.write_to_binary(expected)
+
+        assert %{
+                 binary: ^binary,
+                 width: width,
+                 height: height,
+                 bands: bands,
+                 band_format: :VIPS_FORMAT_UCHAR
+               } = result
+
+        assert {width, height, bands} == Image.shape(expected)
+      end)
+    end
+
+    test "returns a contiguous binary with offsets" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      areas = [[left: 0, top: 0, width: 10, height: 10], [left: 5, top: 5, width: 20, height: 2]]
+
+      assert {:ok, list} = Image.write_areas_to_binary(im, areas)
+
+      assert {:ok, %{binary: binary, areas: offsets, band_format: :VIPS_FORMAT_UCHAR}} =
+               Image.write_areas_to_binary(im, areas, contiguous: true)
+
+      assert [%{offset: 0, size: 300}, %{offset: 300, size: 120}] = offsets
+      assert binary == Enum.map_join(list, & &1.binary)
+    end
+
+    test "returns error for out of bound area" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      assert {:error, "Bad extract area. Ensure params are not out of bound"} =
+               Image.write_areas_to_binary(im, [[left: 500, top: 0, width: 100, height: 10]])
+    end
+  end
+
+  describe "stream_pixels" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "streams strips which add up to the whole image" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      strips = im |> Image.stream_pixels(tile_height: 100, readahead: 2) |> Enum.to_list()
+
+      assert Enum.map(strips, &{&1.top, &1.height}) ==
+               [{0, 100}, {100, 100}, {200, 100}, {300, 89}]
+      assert Enum.all?(strips, &(&1.left == 0 and &1.width == 518 and &1.bands == 3))
+
+      {:ok, binary} = Image.write_to_binary(im)
+      assert Enum.map_join(strips, & &1.binary) == binary
+    end
+
+    test "streams tiles in row-major order" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      tiles = im |> Image.stream_pixels(tile_width: 300, tile_height: 200) |> Enum.to_list()
+
+      assert Enum.map(tiles, &{&1.left, &1.top, &1.width, &1.height}) == [
+               {0, 0, 300, 200},
+               {300, 0, 218, 200},
+               {0, 200, 300, 189},
+               {300, 200, 218, 189}
+             ]
+
+      assert %{binary: binary} = List.last(tiles)
+      assert byte_size(binary) == 218 * 189 * 3
+    end
+
+    test "raises for invalid options" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      assert_raise ArgumentError, fn -> Image.stream_pixels(im, tile_height: 0) end
+    end
+  end
+
   test "get_header binary" do
     {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
     assert {:ok, <<_::binary>>} = Image.header_value(im, "exif-data")
@@ -281,6 +427,55 @@ defmodule Vix.Vips.ImageTest do
     end
   end
 
+  describe "cancellation" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "write_to_buffer completes before the deadline" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      assert {:ok, <<0xFF, 0xD8, _::binary>>} =
+               Image.write_to_buffer(im, ".jpg", Q: 50, timeout: 60_000, owner: self())
+    end
+
+    test "timeout: :infinity sets no deadline" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      out_path = Briefly.create!(extname: ".jpg")
+
+      assert {:ok, <<0xFF, 0xD8, _::binary>>} =
+               Image.write_to_buffer(im, ".jpg", timeout: :infinity)
+
+      assert :ok = Image.write_to_file(im, out_path, timeout: :infinity, owner: self())
+    end
+
+    test "write_to_buffer returns cancelled when the deadline passes" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      assert {:error, :cancelled} = Image.write_to_buffer(im, ".jpg", timeout: 0)
+
+      # long running computation is stopped midway
+      im = Operation.black!(8000, 8000) |> Operation.gaussblur!(40.0)
+      assert {:error, :cancelled} = Image.write_to_buffer(im, ".png", timeout: 50)
+    end
+
+    test "write_to_file returns cancelled when the owner is dead" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      out_path = Briefly.create!(extname: ".png")
+
+      owner = spawn(fn -> :ok end)
+      ref = Process.monitor(owner)
+      assert_receive {:DOWN, ^ref, :process, ^owner, _}
+
+      assert {:error, :cancelled} = Image.write_to_file(im, out_path, owner: owner)
+    end
+
+    test "cancelled write does not affect the source image" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      assert {:error, :cancelled} = Image.write_to_buffer(im, ".png", timeout: 0)
+      assert {:ok, _} = Image.write_to_buffer(im, ".png")
+    end
+  end
+
   test "new image from other image" do
     {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
     {:ok, new_im} = Image.new_from_image(im, [250])
@@ -299,6 +494,10 @@ defmodule Vix.Vips.ImageTest do
   end
 
   describe "new_from_enum" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
     test "new_from_enum" do
       {:ok, image} =
         File.stream!(img_path("puppies.jpg"), 1024, [])
@@ -316,6 +515,17 @@ defmodule Vix.Vips.ImageTest do
       {:error, "Failed to find loader for the source"} = Image.new_from_enum(1..100)
     end
 
+    test "new_from_enum with iodata chunks" do
+      {:ok, img1} = Image.new_from_file(img_path("puppies.jpg"))
+
+      {:ok, img2} =
+        File.stream!(img_path("puppies.jpg"), 1024, [])
+        |> Stream.map(fn <<a::binary-size(10), rest::binary>> -> [a, [rest]] end)
+        |> Image.new_from_enum()
+
+      assert_images_equal(img1, img2)
+    end
+
     test "premature end of new_from_enum" do
       {:error, "Failed to create image from VipsSource"} =
         File.stream!(img_path("puppies.jpg"), 100, [])
@@ -345,6 +555,10 @@ defmodule Vix.Vips.ImageTest do
   end
 
   describe "write_to_stream" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
     test "write_to_stream" do
       {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
 
@@ -394,6 +608,233 @@ defmodule Vix.Vips.ImageTest do
 
       assert IO.iodata_length(buf1) > byte_size(buf2)
     end
+
+    test "output is same as write_to_buffer" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      chunks = Image.write_to_stream(im, ".png", compression: 0) |> Enum.to_list()
+      {:ok, buf} = Image.write_to_buffer(im, ".png", compression: 0)
+
+      assert length(chunks) > 1
+      assert IO.iodata_to_binary(chunks) == buf
+    end
+
+    test "halting early stops the save and leaves no messages" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      assert [chunk] = Image.write_to_stream(im, ".png", compression: 0) |> Enum.take(1)
+      assert byte_size(chunk) > 0
+
+      refute_receive _, 100
+    end
+  end
+
+  describe "release/1" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "release/1 makes later calls fail" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, copy} = Image.copy_memory(im)
+
+      assert :ok = Image.release(copy)
+      # releasing twice is harmless
+      assert :ok = Image.release(copy)
+
+      assert {:error, _} = Image.write_to_buffer(copy, ".png")
+
+      # other images are not affected
+      assert {:ok, _} = Image.write_to_buffer(im, ".png")
+    end
+  end
+
+  describe "binary of images in memory" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "matches the binary of the image pipeline" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, copy} = Image.copy_memory(im)
+
+      assert {:ok, expected} = Image.write_to_tensor(im)
+      assert {:ok, tensor} = Image.write_to_tensor(copy)
+      assert tensor == expected
+
+      # areas are still copied
+      assert {:ok, [_, _, _]} = Image.get_pixel(copy, 10, 10)
+    end
+
+    test "outlives the image" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, expected} = Image.write_to_binary(im)
+
+      {:ok, copy} = Image.copy_memory(im)
+      {:ok, bin} = Image.write_to_binary(copy)
+
+      assert :ok = Image.release(copy)
+      :erlang.garbage_collect()
+
+      assert bin == expected
+    end
+
+    test "is not changed by drawing on the image" do
+      {:ok, im} = Image.build_image(8, 8, [0])
+      {:ok, copy} = Image.copy_memory(im)
+      {:ok, bin} = Image.write_to_binary(copy)
+
+      assert {:ok, mutated} =
+               Image.mutate(copy, fn mut_image ->
+                 Vix.Vips.MutableOperation.draw_rect(mut_image, [255], 0, 0, 8, 8, fill: true)
+               end)
+
+      assert bin == :binary.copy(<<0>>, 64)
+      assert {:ok, ^bin} = Image.write_to_binary(copy)
+      assert {:ok, [255]} = Image.get_pixel(mutated, 0, 0)
+
+      # the image handed out keeps its pixels once the mutable image changes
+      {:ok, mut_image} = MutableImage.new(copy)
+      {:ok, snapshot} = MutableImage.to_image(mut_image)
+      :ok = Vix.Vips.MutableOperation.draw_rect(mut_image, [255], 0, 0, 8, 8, fill: true)
+      :ok = MutableImage.stop(mut_image)
+
+      assert {:ok, [0]} = Image.get_pixel(snapshot, 0, 0)
+    end
+
+    test "of an image made from a binary" do
+      bin = for i <- 1..(64 * 32 * 3), into: <<>>, do: <<rem(i, 256)>>
+      {:ok, im} = Image.new_from_binary(bin, 64, 32, 3, :VIPS_FORMAT_UCHAR)
+
+      assert {:ok, ^bin} = Image.write_to_binary(im)
+    end
+  end
+
+  describe "write_batch_to_tensor" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "writes images as NHWC floats" do
+      a = rgb_image([1, 2, 3, 4, 5, 6])
+      b = rgb_image([7, 8, 9, 10, 11, 12])
+
+      assert {:ok, tensor} = Image.write_batch_to_tensor([a, b])
+
+      assert %Vix.Tensor{
+               shape: {2, 1, 2, 3},
+               names: [:batch, :height, :width, :bands],
+               type: {:f, 32}
+             } = tensor
+
+      assert floats(tensor.data) == Enum.map(1..12, &(&1 * 1.0))
+    end
+
+    test "writes images as NCHW normalized by mean and std" do
+      a = rgb_image([1, 2, 3, 4, 5, 6])
+      b = rgb_image([7, 8, 9, 10, 11, 12])
+
+      assert {:ok, tensor} =
+               Image.write_batch_to_tensor([a, b], layout: :nchw, mean: [1, 2, 3], std: 2)
+
+      assert %Vix.Tensor{shape: {2, 3, 1, 2}, names: [:batch, :bands, :height, :width]} = tensor
+
+      # each band is a plane of (value - mean) / std
+      assert floats(tensor.data) == [0.0, 1.5, 0.0, 1.5, 0.0, 1.5, 3.0, 4.5, 3.0, 4.5, 3.0, 4.5]
+    end
+
+    test "writes double and images not in memory" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, area} = Vix.Vips.Operation.extract_area(im, 0, 0, 4, 4)
+      {:ok, expected} = Image.write_to_binary(area)
+
+      assert {:ok, %Vix.Tensor{data: data, shape: {1, 4, 4, 3}, type: {:f, 64}}} =
+               Image.write_batch_to_tensor([area], type: {:f, 64})
+
+      assert for(<<v::native-float-64 <- data>>, do: v) ==
+               for(<<v::native-unsigned-8 <- expected>>, do: v * 1.0)
+    end
+
+    test "returns error for images of different size" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      assert {:error, "Images must have the same width, height and bands"} =
+               Image.write_batch_to_tensor([im, rgb_image([1, 2, 3, 4, 5, 6])])
+
+      assert {:error, "Images must be a non-empty list"} = Image.write_batch_to_tensor([])
+    end
+
+    test "raises for invalid options" do
+      im = rgb_image([1, 2, 3, 4, 5, 6])
+
+      assert_raise ArgumentError, fn -> Image.write_batch_to_tensor([im], layout: :hwc) end
+      assert_raise ArgumentError, fn -> Image.write_batch_to_tensor([im], type: {:u, 8}) end
+      assert_raise ArgumentError, fn -> Image.write_batch_to_tensor([im], std: [1, 0, 1]) end
+    end
+  end
+
+  describe "write_to_fd" do
+    if @precompiled_nif_mode do
+      @describetag skip: "requires NIF compiled from current source"
+    end
+
+    test "writes encoded image to a nonblocking socket" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, expected} = Image.write_to_buffer(im, ".png", compression: 0)
+
+      {server, client} = socket_pair()
+      {:ok, fd} = :socket.getopt(server, {:otp, :fd})
+
+      task = Task.async(fn -> Image.write_to_fd(im, fd, ".png", compression: 0) end)
+
+      assert {:ok, ^expected} = :gen_tcp.recv(client, byte_size(expected), 5000)
+      assert :ok = Task.await(task)
+    end
+
+    test "writes with suffix options" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, expected} = Image.write_to_buffer(im, ".jpg[Q=50]")
+
+      {server, client} = socket_pair()
+      {:ok, fd} = :socket.getopt(server, {:otp, :fd})
+
+      assert :ok = Image.write_to_fd(im, fd, ".jpg[Q=50]")
+      assert {:ok, ^expected} = :gen_tcp.recv(client, byte_size(expected), 5000)
+    end
+
+    test "times out when the descriptor stays full" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      {server, _client} = socket_pair()
+      {:ok, fd} = :socket.getopt(server, {:otp, :fd})
+      big = Operation.resize!(im, 8)
+
+      assert {:error, _} = Image.write_to_fd(big, fd, ".png", compression: 0, send_timeout: 100)
+    end
+
+    test "does not keep the descriptor open after the write" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+      {:ok, expected} = Image.write_to_buffer(im, ".jpg")
+
+      {server, client} = socket_pair()
+      {:ok, fd} = :socket.getopt(server, {:otp, :fd})
+
+      assert :ok = Image.write_to_fd(im, fd, ".jpg")
+      :ok = :socket.close(server)
+
+      assert {:ok, ^expected} = :gen_tcp.recv(client, byte_size(expected), 5000)
+      assert {:error, :closed} = :gen_tcp.recv(client, 0, 5000)
+    end
+
+    test "returns error for an invalid send_timeout" do
+      {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+      {server, _client} = socket_pair()
+      {:ok, fd} = :socket.getopt(server, {:otp, :fd})
+
+      assert {:error, "send_timeout must be" <> _} =
+               Image.write_to_fd(im, fd, ".jpg", send_timeout: -1)
+    end
   end
 
   test "new_from_binary" do
@@ -531,4 +972,24 @@ defmodule Vix.Vips.ImageTest do
     # Test that copy_memory can be called multiple times
     assert {:ok, _memory_im2} = Image.copy_memory(memory_im)
   end
+
+  # 2x1 RGB image
+  defp rgb_image(pixels) do
+    {:ok, im} = Image.new_from_binary(:binary.list_to_bin(pixels), 2, 1, 3, :VIPS_FORMAT_UCHAR)
+    im
+  end
+
+  defp floats(bin), do: for(<<v::native-float-32 <- bin>>, do: v)
+
+  defp socket_pair do
+    {:ok, listen} = :socket.open(:inet, :stream, :tcp)
+    :ok = :socket.bind(listen, %{family: :inet, addr: :loopback, port: 0})
+    :ok = :socket.listen(listen)
+    {:ok, %{port: port}} = :socket.sockname(listen)
+
+    {:ok, client} = :gen_tcp.connect({127, 0, 0, 1}, port, [:binary, active: false])
+    {:ok, server} = :socket.accept(listen)
+
+    {server, client}
+  end
 end
@@ -6,6 +6,9 @@ defmodule Vix.Vips.OperationTest do
 
   import Vix.Support.Images
 
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   test "invert" do
     {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
     assert {:ok, out} = Operation.invert(im)
@@ -61,6 +64,33 @@ defmodule Vix.Vips.OperationTest do
     assert min in [-0.0, +0.0]
   end
 
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "array outputs as packed binaries" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, values} = Operation.getpoint(im, 10, 10)
+    assert {:ok, bin} = Operation.getpoint(im, 10, 10, array_format: :binary)
+    assert bin == for(v <- values, into: <<>>, do: <<v::native-float-64>>)
+
+    {:ok, im} = Image.new_from_file(img_path("black_on_white.jpg"))
+    assert {:ok, {_, %{"out-array": [min], "x-array": xs}}} = Operation.min(im)
+
+    assert {:ok, {_, %{"out-array": out_bin, "x-array": x_bin}}} =
+             Operation.min(im, array_format: :binary)
+
+    assert out_bin == <<min::native-float-64>>
+    assert x_bin == for(x <- xs, into: <<>>, do: <<x::native-signed-32>>)
+  end
+
+  test "invalid array_format" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert_raise ArgumentError, fn -> Operation.getpoint(im, 10, 10, array_format: :tuple) end
+  end
+
   test "required output order" do
     {:ok, im} = Image.new_from_file(img_path("black_on_white.jpg"))
     assert Operation.find_trim(im) == {:ok, {41, 44, 45, 45}}
@@ -0,0 +1,79 @@
+defmodule Vix.Vips.PipelineTest do
+  use ExUnit.Case, async: true
+
+  alias Vix.Vips.Image
+  alias Vix.Vips.Operation
+  alias Vix.Vips.Pipeline
+
+  import Vix.Support.Images
+
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
+  if @precompiled_nif_mode do
+    @moduletag skip: "requires NIF compiled from current source"
+  end
+
+  test "run returns the same result as individual operation calls" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    pipeline = Pipeline.new()
+    {pipeline, inverted} = Pipeline.add(pipeline, :invert, [im])
+    {pipeline, flipped} = Pipeline.add(pipeline, :flip, [inverted, :VIPS_DIRECTION_HORIZONTAL])
+
+    assert {:ok, %Image{} = out} = Pipeline.run(pipeline, flipped)
+
+    expected =
+      im
+      |> Operation.invert!()
+      |> Operation.flip!(:VIPS_DIRECTION_HORIZONTAL)
+
+    assert_images_equal(out, expected)
+  end
+
+  test "run returns multiple outputs including optional ones" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    pipeline = Pipeline.new()
+    {pipeline, thumb} = Pipeline.add(pipeline, :thumbnail_image, [im, 100])
+    {pipeline, max} = Pipeline.add(pipeline, :max, [thumb], size: 1)
+
+    assert {:ok, [%Image{} = thumb_image, value, x]} =
+             Pipeline.run(pipeline, [thumb, max, Pipeline.output(max, :x)])
+
+    assert Image.width(thumb_image) == 100
+    assert is_float(value)
+    assert is_integer(x)
+  end
+
+  test "run encodes the final image" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    pipeline = Pipeline.new()
+    {pipeline, thumb} = Pipeline.add(pipeline, "thumbnail_image", [im, 100])
+    {pipeline, jpeg} = Pipeline.add(pipeline, "jpegsave_buffer", [thumb], Q: 50)
+
+    assert {:ok, <<0xFF, 0xD8, _::binary>>} = Pipeline.run(pipeline, jpeg)
+  end
+
+  test "run returns error from a failing node" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    pipeline = Pipeline.new()
+    {pipeline, out} = Pipeline.add(pipeline, :extract_area, [im, 0, 0, 100_000, 10])
+
+    assert {:error, "operation build: " <> _} = Pipeline.run(pipeline, out)
+  end
+
+  test "add rejects references to unknown nodes" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert_raise ArgumentError, fn ->
+      Pipeline.add(Pipeline.new(), :invert, [%Pipeline.Ref{node: 0, output: "out"}])
+    end
+
+    assert_raise ArgumentError, fn ->
+      Pipeline.add(Pipeline.new(), :invert, [im, im])
+    end
+  end
+end
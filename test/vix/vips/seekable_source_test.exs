@@ -0,0 +1,162 @@
+defmodule Vix.Vips.SeekableSourceTest do
+  use ExUnit.Case, async: true
+
+  alias Vix.Vips.Image
+  alias Vix.Vips.SeekableSource
+
+  import Vix.Support.Images
+
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
+  if @precompiled_nif_mode do
+    @moduletag skip: "requires NIF compiled from current source"
+  end
+
+  defmodule CountingSource do
+    @behaviour SeekableSource
+
+    @impl true
+    def init({path, parent}) do
+      {:ok, fd} = SeekableSource.File.init(path)
+      {:ok, {fd, parent}}
+    end
+
+    @impl true
+    def size({fd, _parent}), do: SeekableSource.File.size(fd)
+
+    @impl true
+    def read_at({fd, parent}, offset, length) do
+      result = SeekableSource.File.read_at(fd, offset, length)
+
+      with {:ok, data} <- result do
+        send(parent, {:read, offset, byte_size(data)})
+      end
+
+      result
+    end
+
+    @impl true
+    def close({fd, parent}) do
+      send(parent, :closed)
+      SeekableSource.File.close(fd)
+    end
+  end
+
+  defmodule FailingSource do
+    @behaviour SeekableSource
+
+    @impl true
+    def init(reason), do: {:error, reason}
+
+    @impl true
+    def size(_), do: {:ok, nil}
+
+    @impl true
+    def read_at(_, _, _), do: :eof
+  end
+
+  defmodule ErrorSource do
+    @behaviour SeekableSource
+
+    @impl true
+    def init(reason), do: {:ok, reason}
+
+    @impl true
+    def size(_), do: {:ok, 1024}
+
+    @impl true
+    def read_at(reason, _, _), do: {:error, reason}
+  end
+
+  test "loads an image from a file" do
+    {:ok, expected} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, image} =
+             Image.new_from_seekable_source({SeekableSource.File, img_path("puppies.jpg")})
+
+    assert_images_equal(image, expected)
+  end
+
+  test "passing options" do
+    {:ok, expected} = Image.new_from_file(img_path("puppies.jpg"))
+
+    assert {:ok, image} =
+             Image.new_from_seekable_source({SeekableSource.File, img_path("puppies.jpg")},
+               shrink: 2
+             )
+
+    assert Image.width(expected) == 2 * Image.width(image)
+  end
+
+  test "tiff reads only part of the input" do
+    path = img_path("boats.tif")
+    %{size: size} = File.stat!(path)
+
+    assert {:ok, image} = Image.new_from_seekable_source({CountingSource, {path, self()}})
+    assert Image.width(image) > 0
+
+    assert_receive {:read, _offset, length}
+    assert collect_reads(length) < size
+  end
+
+  test "backend is closed once the image is released" do
+    path = img_path("puppies.jpg")
+    parent = self()
+
+    {pid, ref} =
+      spawn_monitor(fn ->
+        {:ok, _image} = Image.new_from_seekable_source({CountingSource, {path, parent}})
+      end)
+
+    assert_receive {:DOWN, ^ref, :process, ^pid, :normal}, 5000
+    assert_receive :closed, 5000
+  end
+
+  test "release/1 frees the image once the calls using it return" do
+    path = img_path("puppies.jpg")
+    {:ok, image} = Image.new_from_seekable_source({CountingSource, {path, self()}})
+    {:ok, expected} = Image.write_to_binary(image)
+
+    tasks = for _ <- 1..8, do: Task.async(fn -> Image.write_to_binary(image) end)
+
+    assert :ok = Image.release(image)
+
+    # calls which got the image before the release complete normally
+    for result <- Task.await_many(tasks, 30_000) do
+      with {:ok, bin} <- result, do: assert(bin == expected)
+    end
+
+    # `image` is still referenced, so only the release can close the backend
+    assert_receive :closed, 5000
+    assert {:error, _} = Image.write_to_binary(image)
+  end
+
+  test "init error is returned" do
+    assert {:error, :enoent} = Image.new_from_seekable_source({FailingSource, :enoent})
+  end
+
+  test "read error is returned" do
+    assert {:error, _} = Image.new_from_seekable_source({ErrorSource, :boom})
+  end
+
+  test "reads from many threads" do
+    path = img_path("boats.tif")
+    {:ok, expected} = Image.new_from_file(path)
+    {:ok, image} = Image.new_from_seekable_source({SeekableSource.File, path})
+
+    1..8
+    |> Task.async_stream(fn _ -> Image.write_to_binary(image) end, max_concurrency: 8)
+    |> Enum.each(fn {:ok, result} ->
+      assert result == Image.write_to_binary(expected)
+    end)
+  end
+
+  defp collect_reads(total) do
+    receive do
+      {:read, _offset, length} -> collect_reads(total + length)
+    after
+      0 -> total
+    end
+  end
+end
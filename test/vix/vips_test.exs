@@ -6,6 +6,9 @@ defmodule Vix.VipsTest do
 
   import Vix.Support.Images
 
+  @precompiled_nif_mode (System.get_env("VIX_COMPILATION_MODE") ||
+                           "PRECOMPILED_NIF_AND_LIBVIPS") == "PRECOMPILED_NIF_AND_LIBVIPS"
+
   test "tracked_get_mem/0" do
     {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
     {:ok, _bin} = Image.write_to_buffer(im, ".png")
@@ -22,4 +25,54 @@ defmodule Vix.VipsTest do
     assert is_integer(usage) && usage > 0
     assert usage >= Vips.tracked_get_mem()
   end
+
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "stats/0" do
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    before = Map.get(Vips.stats(), "invert", %{calls: 0, errors: 0})
+
+    {:ok, _} = Vix.Vips.Operation.invert(im)
+    {:ok, _} = Vix.Vips.Operation.invert(im)
+    {:error, _} = Vix.Vips.Operation.extract_area(im, 0, 0, 100_000, 10)
+
+    stats = Vips.stats()
+
+    assert %{calls: calls, errors: errors, total_time: total_time, histogram: histogram} =
+             stats["invert"]
+
+    # other tests might run concurrently
+    assert calls >= before.calls + 2
+    assert errors >= before.errors
+    assert is_integer(total_time)
+    assert {:infinity, _} = List.last(histogram)
+    assert Enum.sum(Enum.map(histogram, &elem(&1, 1))) >= before.calls + 2
+
+    assert stats["extract_area"].errors >= 1
+  end
+
+  if @precompiled_nif_mode do
+    @tag skip: "requires NIF compiled from current source"
+  end
+
+  test "janitor_queue_depth/0" do
+    assert Vips.janitor_queue_depth() >= 0
+
+    {:ok, im} = Image.new_from_file(img_path("puppies.jpg"))
+
+    # images are collected along with the process heap
+    Enum.each(1..100, fn _ ->
+      Task.await(Task.async(fn -> {:ok, _} = Vix.Vips.Operation.invert(im) end))
+    end)
+
+    :erlang.garbage_collect()
+
+    assert Enum.any?(1..100, fn _ ->
+             Process.sleep(10)
+             Vips.janitor_queue_depth() == 0
+           end)
+  end
 end